@@ -4,7 +4,12 @@
 #include "ns3/point-to-point-module.h"
 #include "ns3/applications-module.h"
 #include "ns3/netanim-module.h"
+#include "ns3/traffic-control-module.h"
 
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 using namespace ns3;
@@ -15,6 +20,672 @@ NS_LOG_COMPONENT_DEFINE("Ex3DdosIds");
 static uint64_t packetsCaptured = 0;
 static uint64_t ddosThreshold = 200; // packets/sec
 
+struct IdsAlarm
+{
+    Time time;
+    Time firstSeen;
+    Ipv4Address source;
+    Ipv4Address destination;
+    double rate; // packets/sec over the window
+};
+
+static inline uint64_t
+FlowKey(Ipv4Address src, Ipv4Address dst)
+{
+    return (static_cast<uint64_t>(src.Get()) << 32) | dst.Get();
+}
+
+// Per-(source, destination) packet-rate detector.
+//
+// Every flow owns a ring of kBuckets counters covering one window; the
+// window sum is kept incrementally, so an update only touches the buckets
+// that expired since the flow's previous packet (at most kBuckets, i.e. O(1)).
+class SlidingWindowRateDetector
+{
+  public:
+    static const uint32_t kBuckets = 10;
+
+    SlidingWindowRateDetector(Time window, uint64_t thresholdPps)
+        : m_window(window),
+          m_bucketWidth(std::max<int64_t>(1, window.GetTimeStep() / kBuckets)),
+          m_thresholdPackets(static_cast<uint64_t>(thresholdPps * window.GetSeconds()))
+    {
+        m_flows.reserve(1024);
+    }
+
+    // Accounts one packet; returns true when this packet raised a new alarm.
+    bool Update(Ipv4Address src, Ipv4Address dst, Time now)
+    {
+        uint64_t key = FlowKey(src, dst);
+        int64_t bucket = now.GetTimeStep() / m_bucketWidth;
+
+        auto res = m_flows.try_emplace(key);
+        FlowState &f = res.first->second;
+        if (res.second)
+        {
+            f.head = bucket;
+            f.firstSeen = now;
+        }
+
+        int64_t advance = bucket - f.head;
+        if (advance >= static_cast<int64_t>(kBuckets))
+        {
+            std::fill(f.counts, f.counts + kBuckets, 0);
+            f.sum = 0;
+        }
+        else
+        {
+            for (int64_t b = f.head + 1; b <= bucket; ++b)
+            {
+                uint32_t &slot = f.counts[b % kBuckets];
+                f.sum -= slot;
+                slot = 0;
+            }
+        }
+        f.head = bucket;
+        f.counts[bucket % kBuckets]++;
+        f.sum++;
+
+        if (f.alarmed || f.sum <= m_thresholdPackets)
+        {
+            return false;
+        }
+
+        f.alarmed = true;
+        m_alarms.push_back({now, f.firstSeen, src, dst, f.sum / m_window.GetSeconds()});
+        return true;
+    }
+
+    const std::vector<IdsAlarm> &GetAlarms() const
+    {
+        return m_alarms;
+    }
+
+    std::size_t GetNFlows() const
+    {
+        return m_flows.size();
+    }
+
+  private:
+    struct FlowState
+    {
+        uint32_t counts[kBuckets] = {};
+        uint32_t sum = 0;
+        int64_t head = 0; // absolute index of the newest bucket
+        Time firstSeen;
+        bool alarmed = false;
+    };
+
+    Time m_window;
+    int64_t m_bucketWidth; // in simulator time steps
+    uint64_t m_thresholdPackets;
+    std::unordered_map<uint64_t, FlowState> m_flows;
+    std::vector<IdsAlarm> m_alarms;
+};
+
+static inline uint64_t
+Mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Count-Min sketch with conservative update. Memory is width x depth
+// counters no matter how many distinct keys are fed in; estimates never
+// under-count. Row indices come from one 64-bit hash split in two
+// (h1 + row * h2), so an update costs a single hash.
+class CountMinSketch
+{
+  public:
+    static constexpr uint32_t kMaxDepth = 16;
+
+    CountMinSketch(uint32_t width, uint32_t depth)
+        : m_width(std::max<uint32_t>(1, width)),
+          m_depth(std::min(std::max<uint32_t>(1, depth), kMaxDepth)),
+          m_counts(static_cast<std::size_t>(m_width) * m_depth, 0)
+    {
+    }
+
+    // Adds one occurrence of key and returns its new estimate.
+    uint32_t Add(uint64_t key)
+    {
+        uint32_t *cells[kMaxDepth];
+        uint32_t min = UINT32_MAX;
+        uint64_t h = Mix64(key);
+        for (uint32_t r = 0; r < m_depth; ++r)
+        {
+            cells[r] = &m_counts[Index(h, r)];
+            min = std::min(min, *cells[r]);
+        }
+        uint32_t estimate = min + 1;
+        for (uint32_t r = 0; r < m_depth; ++r)
+        {
+            *cells[r] = std::max(*cells[r], estimate);
+        }
+        return estimate;
+    }
+
+    uint32_t Estimate(uint64_t key) const
+    {
+        uint32_t min = UINT32_MAX;
+        uint64_t h = Mix64(key);
+        for (uint32_t r = 0; r < m_depth; ++r)
+        {
+            min = std::min(min, m_counts[Index(h, r)]);
+        }
+        return min;
+    }
+
+    void Clear()
+    {
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+    }
+
+    std::size_t GetMemoryBytes() const
+    {
+        return m_counts.size() * sizeof(uint32_t);
+    }
+
+  private:
+    std::size_t Index(uint64_t h, uint32_t row) const
+    {
+        uint32_t h1 = static_cast<uint32_t>(h);
+        uint32_t h2 = static_cast<uint32_t>(h >> 32) | 1;
+        uint32_t col = static_cast<uint32_t>(
+            (static_cast<uint64_t>(h1 + row * h2) * m_width) >> 32);
+        return static_cast<std::size_t>(row) * m_width + col;
+    }
+
+    uint32_t m_width;
+    uint32_t m_depth;
+    std::vector<uint32_t> m_counts;
+};
+
+// Space-Saving heavy-hitter summary: monitors at most k keys. A key that is
+// not monitored replaces the current minimum and inherits its count as
+// over-estimation error, so count - error is a guaranteed lower bound.
+class SpaceSavingTopK
+{
+  public:
+    struct Entry
+    {
+        uint64_t key;
+        uint64_t count;
+        uint64_t error;
+        Time firstSeen; // when the key (last) entered the summary
+    };
+
+    explicit SpaceSavingTopK(uint32_t k)
+        : m_k(std::max<uint32_t>(1, k))
+    {
+        m_entries.reserve(m_k);
+        m_heap.reserve(m_k);
+        m_pos.reserve(m_k);
+        m_index.reserve(2 * m_k);
+    }
+
+    Entry &Add(uint64_t key, Time now)
+    {
+        auto it = m_index.find(key);
+        if (it != m_index.end())
+        {
+            uint32_t slot = it->second;
+            m_entries[slot].count++;
+            SiftDown(m_pos[slot]);
+            return m_entries[slot];
+        }
+
+        uint32_t slot;
+        if (m_entries.size() < m_k)
+        {
+            slot = m_entries.size();
+            m_entries.push_back({key, 1, 0, now});
+            m_pos.push_back(m_heap.size());
+            m_heap.push_back(slot);
+            SiftUp(m_pos[slot]);
+        }
+        else
+        {
+            slot = m_heap[0];
+            Entry &victim = m_entries[slot];
+            m_index.erase(victim.key);
+            victim = {key, victim.count + 1, victim.count, now};
+            SiftDown(0);
+        }
+        m_index[key] = slot;
+        return m_entries[slot];
+    }
+
+    // Monitored entries, largest count first.
+    std::vector<Entry> GetTop() const
+    {
+        std::vector<Entry> top(m_entries);
+        std::sort(top.begin(), top.end(), [](const Entry &a, const Entry &b) {
+            return a.count > b.count;
+        });
+        return top;
+    }
+
+    std::size_t GetMemoryBytes() const
+    {
+        // Index nodes are approximated as key + slot + next pointer.
+        return m_k * (sizeof(Entry) + 2 * sizeof(uint32_t)) +
+               m_index.bucket_count() * sizeof(void *) +
+               m_k * (sizeof(uint64_t) + sizeof(uint32_t) + sizeof(void *));
+    }
+
+  private:
+    bool Less(uint32_t a, uint32_t b) const
+    {
+        return m_entries[m_heap[a]].count < m_entries[m_heap[b]].count;
+    }
+
+    void Swap(uint32_t a, uint32_t b)
+    {
+        std::swap(m_heap[a], m_heap[b]);
+        m_pos[m_heap[a]] = a;
+        m_pos[m_heap[b]] = b;
+    }
+
+    void SiftUp(uint32_t i)
+    {
+        while (i > 0 && Less(i, (i - 1) / 2))
+        {
+            Swap(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    void SiftDown(uint32_t i)
+    {
+        uint32_t n = m_heap.size();
+        while (true)
+        {
+            uint32_t smallest = i;
+            uint32_t l = 2 * i + 1;
+            uint32_t r = l + 1;
+            if (l < n && Less(l, smallest))
+            {
+                smallest = l;
+            }
+            if (r < n && Less(r, smallest))
+            {
+                smallest = r;
+            }
+            if (smallest == i)
+            {
+                return;
+            }
+            Swap(i, smallest);
+            i = smallest;
+        }
+    }
+
+    uint32_t m_k;
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_heap; // min-heap of slots ordered by count
+    std::vector<uint32_t> m_pos;  // slot -> heap position
+    std::unordered_map<uint64_t, uint32_t> m_index;
+};
+
+// Fixed-memory counterpart of SlidingWindowRateDetector. Two Count-Min
+// sketches hold the current and previous window and the rate is estimated
+// as cur + prev * (1 - elapsed / window). A third sketch keeps whole-run
+// totals, a Space-Saving summary tracks the top-K flows and a Bloom filter
+// remembers which flows already alarmed; none of these grow with the number
+// of attackers.
+class SketchRateDetector
+{
+  public:
+    static const uint32_t kMaxStoredAlarms = 1024;
+
+    SketchRateDetector(Time window,
+                       uint64_t thresholdPps,
+                       uint32_t width,
+                       uint32_t depth,
+                       uint32_t topK)
+        : m_window(window),
+          m_windowTs(std::max<int64_t>(1, window.GetTimeStep())),
+          m_thresholdPackets(static_cast<uint64_t>(thresholdPps * window.GetSeconds())),
+          m_cur(width, depth),
+          m_prev(width, depth),
+          m_total(width, depth),
+          m_topK(topK),
+          m_alarmed(std::max<uint32_t>(1, width), 0)
+    {
+        m_alarms.reserve(kMaxStoredAlarms);
+    }
+
+    // Accounts one packet; returns true when this packet raised a new alarm.
+    bool Update(Ipv4Address src, Ipv4Address dst, Time now)
+    {
+        uint64_t key = FlowKey(src, dst);
+        int64_t epoch = now.GetTimeStep() / m_windowTs;
+        if (epoch != m_epoch)
+        {
+            if (epoch == m_epoch + 1)
+            {
+                std::swap(m_cur, m_prev);
+            }
+            else
+            {
+                m_prev.Clear();
+            }
+            m_cur.Clear();
+            m_epoch = epoch;
+        }
+
+        double elapsed = double(now.GetTimeStep() - epoch * m_windowTs) / m_windowTs;
+        double estimate = m_cur.Add(key) + m_prev.Estimate(key) * (1.0 - elapsed);
+        m_total.Add(key);
+
+        SpaceSavingTopK::Entry &e = m_topK.Add(key, now);
+        if (estimate <= m_thresholdPackets || TestAndSetAlarmed(key))
+        {
+            return false;
+        }
+
+        m_nAlarms++;
+        m_last = {now, e.firstSeen, src, dst, estimate / m_window.GetSeconds()};
+        if (m_alarms.size() < kMaxStoredAlarms)
+        {
+            m_alarms.push_back(m_last);
+        }
+        return true;
+    }
+
+    uint32_t EstimateTotal(uint64_t key) const
+    {
+        return m_total.Estimate(key);
+    }
+
+    const IdsAlarm &GetLastAlarm() const
+    {
+        return m_last;
+    }
+
+    // The first kMaxStoredAlarms alarms; GetNAlarms() has the full count.
+    const std::vector<IdsAlarm> &GetAlarms() const
+    {
+        return m_alarms;
+    }
+
+    uint64_t GetNAlarms() const
+    {
+        return m_nAlarms;
+    }
+
+    const SpaceSavingTopK &GetTopK() const
+    {
+        return m_topK;
+    }
+
+    std::size_t GetMemoryBytes() const
+    {
+        return m_cur.GetMemoryBytes() + m_prev.GetMemoryBytes() + m_total.GetMemoryBytes() +
+               m_topK.GetMemoryBytes() + m_alarmed.size() * sizeof(uint64_t) +
+               kMaxStoredAlarms * sizeof(IdsAlarm);
+    }
+
+  private:
+    // Bloom filter (3 probes); a false positive only suppresses a duplicate
+    // alarm for an unrelated flow.
+    bool TestAndSetAlarmed(uint64_t key)
+    {
+        uint64_t h = Mix64(key ^ 0x5bd1e995ULL);
+        uint64_t nBits = m_alarmed.size() * 64;
+        bool seen = true;
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            uint64_t bit = (h + i * (h >> 32)) % nBits;
+            uint64_t mask = 1ULL << (bit % 64);
+            seen = seen && (m_alarmed[bit / 64] & mask);
+            m_alarmed[bit / 64] |= mask;
+        }
+        return seen;
+    }
+
+    Time m_window;
+    int64_t m_windowTs;
+    uint64_t m_thresholdPackets;
+    int64_t m_epoch = 0;
+    CountMinSketch m_cur;
+    CountMinSketch m_prev;
+    CountMinSketch m_total;
+    SpaceSavingTopK m_topK;
+    IdsAlarm m_last;
+    uint64_t m_nAlarms = 0;
+    std::vector<IdsAlarm> m_alarms;
+    std::vector<uint64_t> m_alarmed; // width x 64 bits
+};
+
+// ---------------- Mitigation (Token-Bucket Policer) ----------------
+// Root queue disc for the router's victim-facing device. Sources flagged by
+// the IDS get a token bucket in a flat open-addressing table (linear probing,
+// key 0.0.0.0 = empty slot); their out-of-profile packets are dropped, or
+// ECN-marked when MarkOnly is set and the packet is ECN-capable. Everything
+// else goes straight to a single FIFO, like FifoQueueDisc.
+class DdosPolicerQueueDisc : public QueueDisc
+{
+  public:
+    static constexpr const char *OUT_OF_PROFILE_DROP = "Out-of-profile drop";
+    static constexpr const char *OUT_OF_PROFILE_MARK = "Out-of-profile mark";
+    static constexpr const char *LIMIT_EXCEEDED_DROP = "Queue disc limit exceeded";
+
+    static TypeId GetTypeId()
+    {
+        static TypeId tid =
+            TypeId("DdosPolicerQueueDisc")
+                .SetParent<QueueDisc>()
+                .AddConstructor<DdosPolicerQueueDisc>()
+                .AddAttribute("MaxSize",
+                              "The max queue size",
+                              QueueSizeValue(QueueSize("1000p")),
+                              MakeQueueSizeAccessor(&QueueDisc::SetMaxSize,
+                                                    &QueueDisc::GetMaxSize),
+                              MakeQueueSizeChecker())
+                .AddAttribute("Rate",
+                              "Token rate granted to each flagged source",
+                              DataRateValue(DataRate("100kbps")),
+                              MakeDataRateAccessor(&DdosPolicerQueueDisc::m_rate),
+                              MakeDataRateChecker())
+                .AddAttribute("Burst",
+                              "Bucket depth in bytes for each flagged source",
+                              UintegerValue(10240),
+                              MakeUintegerAccessor(&DdosPolicerQueueDisc::m_burst),
+                              MakeUintegerChecker<uint32_t>())
+                .AddAttribute("MaxSources",
+                              "Number of flagged sources the bucket table can hold",
+                              UintegerValue(4096),
+                              MakeUintegerAccessor(&DdosPolicerQueueDisc::m_maxSources),
+                              MakeUintegerChecker<uint32_t>(1))
+                .AddAttribute("MarkOnly",
+                              "ECN-mark out-of-profile packets instead of dropping them",
+                              BooleanValue(false),
+                              MakeBooleanAccessor(&DdosPolicerQueueDisc::m_markOnly),
+                              MakeBooleanChecker());
+        return tid;
+    }
+
+    DdosPolicerQueueDisc()
+        : QueueDisc(QueueDiscSizePolicy::SINGLE_INTERNAL_QUEUE)
+    {
+    }
+
+    // Starts policing src; returns false if it was already flagged or the
+    // table is full.
+    bool Flag(Ipv4Address src)
+    {
+        uint32_t addr = src.Get();
+        if (addr == 0 || m_table.empty() || m_nFlagged >= m_maxSources)
+        {
+            return false;
+        }
+        uint32_t i = Slot(addr);
+        while (m_table[i].addr != 0)
+        {
+            if (m_table[i].addr == addr)
+            {
+                return false;
+            }
+            i = (i + 1) & m_mask;
+        }
+        m_table[i] = {addr, double(m_burst), Simulator::Now().GetTimeStep()};
+        m_nFlagged++;
+        return true;
+    }
+
+    uint32_t GetNFlagged() const
+    {
+        return m_nFlagged;
+    }
+
+    uint64_t GetNInspected() const
+    {
+        return m_nInspected;
+    }
+
+    uint64_t GetNPoliced() const
+    {
+        return m_nPoliced;
+    }
+
+    double GetCostPerPacketNs() const
+    {
+        return m_nInspected ? double(m_costNs) / m_nInspected : 0.0;
+    }
+
+  private:
+    struct PolicedSource
+    {
+        uint32_t addr;
+        double tokens; // bytes
+        int64_t last;  // time step of the last refill
+    };
+
+    uint32_t Slot(uint32_t addr) const
+    {
+        return (addr * 2654435761u) & m_mask;
+    }
+
+    PolicedSource *Find(uint32_t addr)
+    {
+        for (uint32_t i = Slot(addr); m_table[i].addr != 0; i = (i + 1) & m_mask)
+        {
+            if (m_table[i].addr == addr)
+            {
+                return &m_table[i];
+            }
+        }
+        return nullptr;
+    }
+
+    bool Conforms(PolicedSource &s, uint32_t bytes)
+    {
+        int64_t now = Simulator::Now().GetTimeStep();
+        s.tokens = std::min<double>(m_burst, s.tokens + (now - s.last) * m_bytesPerStep);
+        s.last = now;
+        if (s.tokens < bytes)
+        {
+            return false;
+        }
+        s.tokens -= bytes;
+        return true;
+    }
+
+    bool DoEnqueue(Ptr<QueueDiscItem> item) override
+    {
+        auto start = std::chrono::steady_clock::now();
+        m_nInspected++;
+
+        bool conform = true;
+        if (m_nFlagged > 0)
+        {
+            Ptr<Ipv4QueueDiscItem> ipItem = DynamicCast<Ipv4QueueDiscItem>(item);
+            PolicedSource *s = ipItem ? Find(ipItem->GetHeader().GetSource().Get()) : nullptr;
+            conform = !s || Conforms(*s, item->GetSize());
+        }
+
+        bool enqueued = false;
+        if (!conform && !(m_markOnly && Mark(item, OUT_OF_PROFILE_MARK)))
+        {
+            m_nPoliced++;
+            DropBeforeEnqueue(item, OUT_OF_PROFILE_DROP);
+        }
+        else if (GetCurrentSize() + item > GetMaxSize())
+        {
+            DropBeforeEnqueue(item, LIMIT_EXCEEDED_DROP);
+        }
+        else
+        {
+            enqueued = GetInternalQueue(0)->Enqueue(item);
+        }
+
+        m_costNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        return enqueued;
+    }
+
+    Ptr<QueueDiscItem> DoDequeue() override
+    {
+        return GetInternalQueue(0)->Dequeue();
+    }
+
+    bool CheckConfig() override
+    {
+        if (GetNQueueDiscClasses() > 0 || GetNPacketFilters() > 0)
+        {
+            NS_LOG_ERROR("DdosPolicerQueueDisc takes no classes or packet filters");
+            return false;
+        }
+        if (GetNInternalQueues() == 0)
+        {
+            AddInternalQueue(CreateObjectWithAttributes<DropTailQueue<QueueDiscItem>>(
+                "MaxSize",
+                QueueSizeValue(GetMaxSize())));
+        }
+        return GetNInternalQueues() == 1;
+    }
+
+    void InitializeParams() override
+    {
+        uint32_t capacity = 1;
+        while (capacity < 2 * m_maxSources)
+        {
+            capacity <<= 1;
+        }
+        m_table.assign(capacity, PolicedSource{0, 0.0, 0});
+        m_mask = capacity - 1;
+        m_bytesPerStep = m_rate.GetBitRate() / 8.0 / Seconds(1).GetTimeStep();
+    }
+
+    DataRate m_rate;
+    uint32_t m_burst;
+    uint32_t m_maxSources;
+    bool m_markOnly;
+    double m_bytesPerStep = 0;
+    std::vector<PolicedSource> m_table;
+    uint32_t m_mask = 0;
+    uint32_t m_nFlagged = 0;
+    uint64_t m_nInspected = 0;
+    uint64_t m_nPoliced = 0;
+    uint64_t m_costNs = 0;
+};
+
+NS_OBJECT_ENSURE_REGISTERED(DdosPolicerQueueDisc);
+
+static SlidingWindowRateDetector *idsDetector = nullptr;
+static SketchRateDetector *idsSketch = nullptr;
+// Exact per-flow totals, only kept to validate the sketch (--exactCounts).
+static std::unordered_map<uint64_t, uint64_t> *idsExactCounts = nullptr;
+static DdosPolicerQueueDisc *idsPolicer = nullptr; // set when --mitigate is on
+static uint64_t idsCostNs = 0; // wall-clock time spent inside the IDS callback
+
 bool
 PromiscEavesdrop(Ptr<NetDevice> device,
                  Ptr<const Packet> packet,
@@ -23,43 +694,198 @@ PromiscEavesdrop(Ptr<NetDevice> device,
                  const Address &to,
                  NetDevice::PacketType packetType)
 {
+    auto start = std::chrono::steady_clock::now();
     packetsCaptured++;
 
-    if (packetsCaptured % 50 == 0)
+    // The PPP header is already stripped: read the IPv4 addresses straight
+    // out of the packet buffer instead of deserializing a full Ipv4Header.
+    uint8_t ip[20];
+    if (protocol == 0x0800 && packet->CopyData(ip, sizeof(ip)) == sizeof(ip))
     {
-        std::cout << "[IDS] Time=" << Simulator::Now().GetSeconds()
-                  << "s  Captured packets=" << packetsCaptured << std::endl;
+        Ipv4Address src((uint32_t(ip[12]) << 24) | (uint32_t(ip[13]) << 16) |
+                        (uint32_t(ip[14]) << 8) | ip[15]);
+        Ipv4Address dst((uint32_t(ip[16]) << 24) | (uint32_t(ip[17]) << 16) |
+                        (uint32_t(ip[18]) << 8) | ip[19]);
+
+        if (idsExactCounts)
+        {
+            (*idsExactCounts)[FlowKey(src, dst)]++;
+        }
+
+        bool alarm = idsSketch ? idsSketch->Update(src, dst, Simulator::Now())
+                               : idsDetector->Update(src, dst, Simulator::Now());
+        if (alarm)
+        {
+            const IdsAlarm &a =
+                idsSketch ? idsSketch->GetLastAlarm() : idsDetector->GetAlarms().back();
+            std::cout << "[IDS] ALARM Time=" << a.time.GetSeconds() << "s  " << a.source
+                      << " -> " << a.destination << "  rate=" << a.rate
+                      << " pkt/s (threshold " << ddosThreshold << ")" << std::endl;
+
+            if (idsPolicer && idsPolicer->Flag(a.source))
+            {
+                std::cout << "[IPS] Time=" << a.time.GetSeconds() << "s  rate-limiting "
+                          << a.source << std::endl;
+            }
+        }
     }
 
+    idsCostNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
     return true; // required
 }
 
-// ---------------- Main ----------------
-int
-main(int argc, char *argv[])
+void
+PrintIdsReport(Time attackStart)
 {
-    uint32_t numAttackers = 3;
-    double simTime = 20.0;
+    const std::vector<IdsAlarm> &alarms =
+        idsSketch ? idsSketch->GetAlarms() : idsDetector->GetAlarms();
 
-    CommandLine cmd;
-    cmd.AddValue("numAttackers", "Number of attacking nodes", numAttackers);
-    cmd.Parse(argc, argv);
+    std::cout << "\n=== IDS REPORT ===" << std::endl;
+    std::cout << "Packets inspected: " << packetsCaptured << std::endl;
+    if (idsSketch)
+    {
+        std::cout << "Sketch memory: " << idsSketch->GetMemoryBytes() / 1024.0
+                  << " KiB (fixed)" << std::endl;
+        std::cout << "Alarms raised: " << idsSketch->GetNAlarms() << std::endl;
+    }
+    else
+    {
+        std::cout << "Flows tracked: " << idsDetector->GetNFlows() << std::endl;
+        std::cout << "Alarms raised: " << alarms.size() << std::endl;
+    }
 
-    // ---------------- Nodes ----------------
-    NodeContainer victim;
-    victim.Create(1);
+    if (packetsCaptured > 0)
+    {
+        std::cout << "Per-packet IDS cost: " << double(idsCostNs) / packetsCaptured
+                  << " ns (wall clock, includes timer overhead)" << std::endl;
+    }
 
-    NodeContainer attackers;
-    attackers.Create(numAttackers);
+    if (alarms.empty())
+    {
+        return;
+    }
+
+    double sumFirstSeen = 0;
+    double maxFirstSeen = 0;
+    double sumAttack = 0;
+    for (const auto &a : alarms)
+    {
+        double sinceFirst = (a.time - a.firstSeen).GetMilliSeconds();
+        sumFirstSeen += sinceFirst;
+        maxFirstSeen = std::max(maxFirstSeen, sinceFirst);
+        sumAttack += (a.time - attackStart).GetMilliSeconds();
+    }
+    std::cout << "Detection latency since first packet of flow: avg "
+              << sumFirstSeen / alarms.size() << " ms, max " << maxFirstSeen << " ms"
+              << std::endl;
+    std::cout << "Detection latency since attack start: avg " << sumAttack / alarms.size()
+              << " ms" << std::endl;
+}
+
+void
+PrintSketchAccuracy(uint32_t nTop)
+{
+    std::vector<SpaceSavingTopK::Entry> top = idsSketch->GetTopK().GetTop();
+
+    std::cout << "\n=== TOP FLOWS (estimated vs. exact packets) ===" << std::endl;
+    for (uint32_t i = 0; i < top.size() && i < nTop; ++i)
+    {
+        const SpaceSavingTopK::Entry &e = top[i];
+        std::cout << "  " << Ipv4Address(static_cast<uint32_t>(e.key >> 32)) << " -> "
+                  << Ipv4Address(static_cast<uint32_t>(e.key)) << "  space-saving=" << e.count
+                  << " (err<=" << e.error << ")"
+                  << "  count-min=" << idsSketch->EstimateTotal(e.key);
+        if (idsExactCounts)
+        {
+            auto it = idsExactCounts->find(e.key);
+            std::cout << "  exact=" << (it != idsExactCounts->end() ? it->second : 0);
+        }
+        std::cout << std::endl;
+    }
+
+    if (!idsExactCounts || idsExactCounts->empty())
+    {
+        return;
+    }
+
+    double sumRelErr = 0;
+    double maxRelErr = 0;
+    for (const auto &kv : *idsExactCounts)
+    {
+        double relErr = double(idsSketch->EstimateTotal(kv.first) - kv.second) / kv.second;
+        sumRelErr += relErr;
+        maxRelErr = std::max(maxRelErr, relErr);
+    }
+    std::cout << "Count-Min relative over-estimate across " << idsExactCounts->size()
+              << " flows: avg " << 100.0 * sumRelErr / idsExactCounts->size() << "%, max "
+              << 100.0 * maxRelErr << "%" << std::endl;
+}
 
+// ---------------- Topology ----------------
+// Legacy layout: one p2p link and one /24 per attacker straight to the
+// router, routes from Ipv4GlobalRoutingHelper. Botnet layout: attackers
+// hang off a few access routers; each attacker link gets a /30 out of its
+// access router's /16 aggregate, and routing is a handful
+// of static default/aggregate routes instead of a global SPF run.
+struct DdosTopology
+{
+    NodeContainer victim;
+    NodeContainer attackers;
     NodeContainer router;
-    router.Create(1);
+    NodeContainer legit;
+    NodeContainer access; // botnet only
+    NetDeviceContainer vr;
+    NetDeviceContainer lr;
+    NetDeviceContainer ingress; // router-side devices facing the attackers
+    // Legacy: one container per attacker. Botnet: one per access router,
+    // holding (attacker, access) device pairs in attacker order.
+    std::vector<NetDeviceContainer> attackerDevices;
+    std::vector<NetDeviceContainer> accessLinks; // botnet: access <-> router
+    Ipv4InterfaceContainer vrIf;
+};
+
+struct SetupTiming
+{
+    double buildMs = 0;   // nodes, stacks and links
+    double addressMs = 0; // address assignment
+    double routingMs = 0; // route population
+};
+
+static double
+ElapsedMs(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since)
+        .count();
+}
+
+void
+BuildTopology(DdosTopology &t,
+              uint32_t numAttackers,
+              bool botnet,
+              uint32_t nAccess,
+              SetupTiming &timing)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // ---------------- Nodes ----------------
+    t.victim.Create(1);
+    t.attackers.Create(numAttackers);
+    t.router.Create(1);
+    t.legit.Create(1); // well-behaved client whose goodput we protect
+    if (botnet)
+    {
+        t.access.Create(nAccess);
+    }
 
     // ---------------- Internet Stack ----------------
     InternetStackHelper internet;
-    internet.Install(victim);
-    internet.Install(attackers);
-    internet.Install(router);
+    internet.Install(t.victim);
+    internet.Install(t.attackers);
+    internet.Install(t.router);
+    internet.Install(t.legit);
+    internet.Install(t.access);
 
     // ---------------- Links ----------------
     PointToPointHelper p2p;
@@ -67,34 +893,287 @@ main(int argc, char *argv[])
     p2p.SetChannelAttribute("Delay", StringValue("2ms"));
 
     // Victim <-> Router
-    NetDeviceContainer vr = p2p.Install(victim.Get(0), router.Get(0));
+    t.vr = p2p.Install(t.victim.Get(0), t.router.Get(0));
 
-    // Attackers <-> Router
-    std::vector<NetDeviceContainer> attackerDevices(numAttackers);
-    for (uint32_t i = 0; i < numAttackers; ++i)
+    if (!botnet)
+    {
+        // Attackers <-> Router
+        t.attackerDevices.resize(numAttackers);
+        for (uint32_t i = 0; i < numAttackers; ++i)
+        {
+            t.attackerDevices[i] = p2p.Install(t.attackers.Get(i), t.router.Get(0));
+            t.ingress.Add(t.attackerDevices[i].Get(1));
+        }
+    }
+    else
     {
-        attackerDevices[i] = p2p.Install(attackers.Get(i), router.Get(0));
+        // Access routers <-> Router, attackers <-> Access routers
+        t.accessLinks.resize(nAccess);
+        t.attackerDevices.resize(nAccess);
+        for (uint32_t j = 0; j < nAccess; ++j)
+        {
+            t.accessLinks[j] = p2p.Install(t.access.Get(j), t.router.Get(0));
+            t.ingress.Add(t.accessLinks[j].Get(1));
+        }
+        for (uint32_t i = 0; i < numAttackers; ++i)
+        {
+            t.attackerDevices[i % nAccess].Add(
+                p2p.Install(t.attackers.Get(i), t.access.Get(i % nAccess)));
+        }
     }
 
+    // Legit client <-> Router
+    t.lr = p2p.Install(t.legit.Get(0), t.router.Get(0));
+
+    timing.buildMs = ElapsedMs(start);
+}
+
+static void
+SetDefaultRoute(Ptr<NetDevice> dev, Ipv4Address gateway)
+{
+    Ptr<Ipv4> ip = dev->GetNode()->GetObject<Ipv4>();
+    Ipv4StaticRoutingHelper helper;
+    helper.GetStaticRouting(ip)->SetDefaultRoute(gateway, ip->GetInterfaceForDevice(dev));
+}
+
+void
+AddressAndRoute(DdosTopology &t, bool botnet, SetupTiming &timing)
+{
+    auto start = std::chrono::steady_clock::now();
+
     // ---------------- IP Addressing ----------------
     Ipv4AddressHelper ipv4;
 
     ipv4.SetBase("10.0.0.0", "255.255.255.0");
-    Ipv4InterfaceContainer vrIf = ipv4.Assign(vr);
+    t.vrIf = ipv4.Assign(t.vr);
 
-    std::vector<Ipv4InterfaceContainer> attackerIf(numAttackers);
-    for (uint32_t i = 0; i < numAttackers; ++i)
+    ipv4.SetBase("172.16.0.0", "255.255.255.0");
+    Ipv4InterfaceContainer lrIf = ipv4.Assign(t.lr);
+
+    std::vector<Ipv4InterfaceContainer> accessIf(t.accessLinks.size());
+    std::vector<Ipv4InterfaceContainer> blockIf(t.attackerDevices.size());
+    if (!botnet)
+    {
+        // 10.0.1.0/24, 10.0.2.0/24, ... carrying into the second octet
+        ipv4.SetBase("10.0.1.0", "255.255.255.0");
+        for (uint32_t i = 0; i < t.attackerDevices.size(); ++i)
+        {
+            blockIf[i] = ipv4.Assign(t.attackerDevices[i]);
+            ipv4.NewNetwork();
+        }
+    }
+    else
+    {
+        // Access uplinks first so they become interface 1 on each access router
+        ipv4.SetBase("10.255.0.0", "255.255.255.252");
+        for (uint32_t j = 0; j < t.accessLinks.size(); ++j)
+        {
+            accessIf[j] = ipv4.Assign(t.accessLinks[j]);
+            ipv4.NewNetwork();
+        }
+        // Access router j aggregates 10.(128+j).0.0/16, carved into one /30
+        // per bot link; 10.255.0.0/16 stays reserved for the uplinks.
+        if (t.attackerDevices.size() > 127)
+        {
+            NS_FATAL_ERROR("Botnet mode supports at most 127 access routers");
+        }
+        for (uint32_t j = 0; j < t.attackerDevices.size(); ++j)
+        {
+            const NetDeviceContainer &links = t.attackerDevices[j];
+            if (links.GetN() / 2 > (1u << 14))
+            {
+                NS_FATAL_ERROR("More than 16384 bots on access router " << j);
+            }
+            ipv4.SetBase(Ipv4Address(0x0a800000u + (j << 16)), Ipv4Mask("255.255.255.252"));
+            for (uint32_t pair = 0; pair < links.GetN(); pair += 2)
+            {
+                NetDeviceContainer link(links.Get(pair));
+                link.Add(links.Get(pair + 1));
+                blockIf[j].Add(ipv4.Assign(link));
+                ipv4.NewNetwork();
+            }
+        }
+    }
+
+    timing.addressMs = ElapsedMs(start);
+    start = std::chrono::steady_clock::now();
+
+    // ---------------- Routing ----------------
+    if (!botnet)
+    {
+        Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+    }
+    else
+    {
+        Ipv4StaticRoutingHelper helper;
+        Ptr<Ipv4> core = t.router.Get(0)->GetObject<Ipv4>();
+        Ptr<Ipv4StaticRouting> coreRt = helper.GetStaticRouting(core);
+
+        SetDefaultRoute(t.vr.Get(0), t.vrIf.GetAddress(1));
+        SetDefaultRoute(t.lr.Get(0), lrIf.GetAddress(1));
+
+        uint32_t nAccess = t.accessLinks.size();
+        for (uint32_t j = 0; j < nAccess; ++j)
+        {
+            SetDefaultRoute(t.accessLinks[j].Get(0), accessIf[j].GetAddress(1));
+            coreRt->AddNetworkRouteTo(Ipv4Address(0x0a800000u + (j << 16)),
+                                      Ipv4Mask("255.255.0.0"),
+                                      accessIf[j].GetAddress(0),
+                                      core->GetInterfaceForDevice(t.accessLinks[j].Get(1)));
+        }
+        // Bots only send, so one default route each is all they need; the
+        // access routers forward the flood upstream on their default route.
+        for (uint32_t i = 0; i < t.attackers.GetN(); ++i)
+        {
+            uint32_t pair = 2 * (i / nAccess);
+            SetDefaultRoute(t.attackerDevices[i % nAccess].Get(pair),
+                            blockIf[i % nAccess].GetAddress(pair + 1));
+        }
+    }
+
+    timing.routingMs = ElapsedMs(start);
+}
+
+void
+RunStartupBenchmark(uint32_t nAccess, uint32_t legacyMax)
+{
+    std::cout << "\n=== STARTUP BENCHMARK (wall clock) ===" << std::endl;
+    std::cout << "attackers  layout   build(ms)  address(ms)  routing(ms)  total(ms)" << std::endl;
+
+    for (uint32_t n : {100u, 1000u, 10000u})
+    {
+        for (bool botnet : {false, true})
+        {
+            const char *layout = botnet ? "botnet" : "legacy";
+            if (!botnet && n > legacyMax)
+            {
+                std::cout << n << "  " << layout << "  skipped (raise --benchLegacyMax)"
+                          << std::endl;
+                continue;
+            }
+
+            DdosTopology t;
+            SetupTiming timing;
+            BuildTopology(t, n, botnet, nAccess, timing);
+            AddressAndRoute(t, botnet, timing);
+            std::cout << n << "  " << layout << "  " << timing.buildMs << "  "
+                      << timing.addressMs << "  " << timing.routingMs << "  "
+                      << timing.buildMs + timing.addressMs + timing.routingMs << std::endl;
+
+            Simulator::Destroy();
+            Ipv4AddressGenerator::Reset();
+        }
+    }
+}
+
+// ---------------- Main ----------------
+int
+main(int argc, char *argv[])
+{
+    uint32_t numAttackers = 3;
+    double simTime = 20.0;
+    Time idsWindow = Seconds(1.0);
+    std::string idsMode = "exact";
+    uint32_t cmWidth = 2048;
+    uint32_t cmDepth = 4;
+    uint32_t topK = 64;
+    bool exactCounts = false;
+    bool mitigate = false;
+    DataRate policeRate("100kbps");
+    uint32_t policeBurst = 10240;
+    bool botnet = false;
+    uint32_t accessRouters = 4;
+    DataRate attackRate("3Mbps");
+    bool benchStartup = false;
+    uint32_t benchLegacyMax = 1000;
+    bool enableAnim = true;
+
+    CommandLine cmd;
+    cmd.AddValue("numAttackers", "Number of attacking nodes", numAttackers);
+    cmd.AddValue("ddosThreshold", "IDS alarm threshold in packets/sec per flow", ddosThreshold);
+    cmd.AddValue("idsWindow", "IDS sliding window length", idsWindow);
+    cmd.AddValue("idsMode", "IDS state: exact (per-flow table) or sketch (fixed memory)", idsMode);
+    cmd.AddValue("cmWidth", "Count-Min sketch width (counters per row)", cmWidth);
+    cmd.AddValue("cmDepth", "Count-Min sketch depth (rows)", cmDepth);
+    cmd.AddValue("topK", "Heavy-hitter flows tracked by Space-Saving", topK);
+    cmd.AddValue("exactCounts", "Also keep exact per-flow counts to validate the sketch", exactCounts);
+    cmd.AddValue("mitigate", "Rate-limit flagged sources on the router", mitigate);
+    cmd.AddValue("policeRate", "Token rate per flagged source", policeRate);
+    cmd.AddValue("policeBurst", "Token bucket depth in bytes per flagged source", policeBurst);
+    cmd.AddValue("botnet", "Aggregate attackers behind access routers with static routing", botnet);
+    cmd.AddValue("accessRouters", "Access routers in botnet mode", accessRouters);
+    cmd.AddValue("attackRate", "Flood rate per attacker", attackRate);
+    cmd.AddValue("benchStartup", "Time topology setup for 100/1k/10k attackers and exit", benchStartup);
+    cmd.AddValue("benchLegacyMax", "Largest attacker count benchmarked with the legacy layout", benchLegacyMax);
+    cmd.AddValue("anim", "Write the NetAnim trace", enableAnim);
+    cmd.Parse(argc, argv);
+    accessRouters = std::max<uint32_t>(1, accessRouters);
+
+    std::unique_ptr<SlidingWindowRateDetector> detector;
+    std::unique_ptr<SketchRateDetector> sketch;
+    std::unordered_map<uint64_t, uint64_t> exact;
+    if (idsMode == "sketch")
+    {
+        sketch.reset(new SketchRateDetector(idsWindow, ddosThreshold, cmWidth, cmDepth, topK));
+        idsSketch = sketch.get();
+        idsExactCounts = exactCounts ? &exact : nullptr;
+    }
+    else if (idsMode == "exact")
+    {
+        detector.reset(new SlidingWindowRateDetector(idsWindow, ddosThreshold));
+        idsDetector = detector.get();
+    }
+    else
+    {
+        NS_FATAL_ERROR("Unknown idsMode " << idsMode << " (expected exact or sketch)");
+    }
+
+    if (benchStartup)
+    {
+        RunStartupBenchmark(accessRouters, benchLegacyMax);
+        return 0;
+    }
+
+    DdosTopology topo;
+    SetupTiming timing;
+    BuildTopology(topo, numAttackers, botnet, accessRouters, timing);
+
+    NodeContainer &victim = topo.victim;
+    NodeContainer &attackers = topo.attackers;
+    NodeContainer &router = topo.router;
+    NodeContainer &legit = topo.legit;
+    NetDeviceContainer &vr = topo.vr;
+    NetDeviceContainer &lr = topo.lr;
+
+    // ---------------- Mitigation ----------------
+    // Must be installed before addressing, which would otherwise put the
+    // default pfifo_fast on the device.
+    Ptr<DdosPolicerQueueDisc> policer;
+    if (mitigate)
     {
-        std::ostringstream subnet;
-        subnet << "10.0." << i + 1 << ".0";
-        ipv4.SetBase(subnet.str().c_str(), "255.255.255.0");
-        attackerIf[i] = ipv4.Assign(attackerDevices[i]);
+        TrafficControlHelper tch;
+        tch.SetRootQueueDisc("DdosPolicerQueueDisc",
+                             "Rate",
+                             DataRateValue(policeRate),
+                             "Burst",
+                             UintegerValue(policeBurst));
+        QueueDiscContainer qdiscs = tch.Install(vr.Get(1));
+        policer = DynamicCast<DdosPolicerQueueDisc>(qdiscs.Get(0));
+        idsPolicer = PeekPointer(policer);
     }
 
-    Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+    AddressAndRoute(topo, botnet, timing);
+    Ipv4InterfaceContainer &vrIf = topo.vrIf;
+
+    std::cout << "Setup (" << (botnet ? "botnet" : "legacy") << ", " << numAttackers
+              << " attackers): build " << timing.buildMs << " ms, addressing "
+              << timing.addressMs << " ms, routing " << timing.routingMs << " ms" << std::endl;
 
     // ---------------- Applications ----------------
     uint16_t victimPort = 9000;
+    uint16_t legitPort = 9001;
+    Time attackStart = Seconds(1.0);
+    Time legitStart = Seconds(0.5);
 
     PacketSinkHelper sink("ns3::UdpSocketFactory",
                           InetSocketAddress(Ipv4Address::GetAny(), victimPort));
@@ -102,44 +1181,107 @@ main(int argc, char *argv[])
     sinkApp.Start(Seconds(0.0));
     sinkApp.Stop(Seconds(simTime));
 
+    PacketSinkHelper legitSink("ns3::UdpSocketFactory",
+                               InetSocketAddress(Ipv4Address::GetAny(), legitPort));
+    ApplicationContainer legitSinkApp = legitSink.Install(victim.Get(0));
+    legitSinkApp.Start(Seconds(0.0));
+    legitSinkApp.Stop(Seconds(simTime));
+
+    // Legitimate traffic, well below ddosThreshold
+    OnOffHelper client("ns3::UdpSocketFactory", InetSocketAddress(vrIf.GetAddress(0), legitPort));
+    client.SetAttribute("DataRate", DataRateValue(DataRate("500kbps")));
+    client.SetAttribute("PacketSize", UintegerValue(1024));
+    client.SetAttribute("OnTime", StringValue("ns3::ConstantRandomVariable[Constant=1]"));
+    client.SetAttribute("OffTime", StringValue("ns3::ConstantRandomVariable[Constant=0]"));
+    ApplicationContainer clientApp = client.Install(legit.Get(0));
+    clientApp.Start(legitStart);
+    clientApp.Stop(Seconds(simTime));
+
     // DDoS traffic (high-rate UDP flood)
     for (uint32_t i = 0; i < numAttackers; ++i)
     {
         OnOffHelper attack("ns3::UdpSocketFactory",
                             InetSocketAddress(vrIf.GetAddress(0), victimPort));
-        attack.SetAttribute("DataRate", DataRateValue(DataRate("3Mbps")));
+        attack.SetAttribute("DataRate", DataRateValue(attackRate));
         attack.SetAttribute("PacketSize", UintegerValue(1024));
         attack.SetAttribute("OnTime", StringValue("ns3::ConstantRandomVariable[Constant=1]"));
         attack.SetAttribute("OffTime", StringValue("ns3::ConstantRandomVariable[Constant=0]"));
 
         ApplicationContainer app = attack.Install(attackers.Get(i));
-        app.Start(Seconds(1.0));
+        app.Start(attackStart);
         app.Stop(Seconds(simTime));
     }
 
     // ---------------- IDS (Promiscuous Mode) ----------------
-    for (uint32_t i = 0; i < vr.GetN(); ++i)
+    if (mitigate)
     {
-        vr.Get(i)->SetPromiscReceiveCallback(MakeCallback(&PromiscEavesdrop));
+        // The policer needs pre-congestion rates, so tap the router's
+        // ingress devices instead of the (already congested) victim link.
+        for (uint32_t i = 0; i < topo.ingress.GetN(); ++i)
+        {
+            topo.ingress.Get(i)->SetPromiscReceiveCallback(MakeCallback(&PromiscEavesdrop));
+        }
+        lr.Get(1)->SetPromiscReceiveCallback(MakeCallback(&PromiscEavesdrop));
+    }
+    else
+    {
+        for (uint32_t i = 0; i < vr.GetN(); ++i)
+        {
+            vr.Get(i)->SetPromiscReceiveCallback(MakeCallback(&PromiscEavesdrop));
+        }
     }
 
     // ---------------- NetAnim ----------------
-    AnimationInterface anim("ex3-ddos-ids.xml");
-    anim.SetConstantPosition(victim.Get(0), 0.0, 10.0);
-    anim.SetConstantPosition(router.Get(0), 20.0, 10.0);
-
-    for (uint32_t i = 0; i < numAttackers; ++i)
+    std::unique_ptr<AnimationInterface> anim;
+    if (enableAnim)
     {
-        anim.SetConstantPosition(attackers.Get(i), 10.0, 20.0 + i * 5);
+        anim.reset(new AnimationInterface("ex3-ddos-ids.xml"));
+        AnimationInterface::SetConstantPosition(victim.Get(0), 0.0, 10.0);
+        AnimationInterface::SetConstantPosition(router.Get(0), 20.0, 10.0);
+        AnimationInterface::SetConstantPosition(legit.Get(0), 30.0, 20.0);
+
+        for (uint32_t j = 0; j < topo.access.GetN(); ++j)
+        {
+            AnimationInterface::SetConstantPosition(topo.access.Get(j), 15.0, 20.0 + j * 5);
+        }
+        for (uint32_t i = 0; i < numAttackers; ++i)
+        {
+            AnimationInterface::SetConstantPosition(attackers.Get(i), 10.0, 20.0 + i * 5);
+        }
     }
 
     // ---------------- Run ----------------
     Simulator::Stop(Seconds(simTime));
     Simulator::Run();
+
+    double legitSeconds = simTime - legitStart.GetSeconds();
+    uint64_t legitRx = DynamicCast<PacketSink>(legitSinkApp.Get(0))->GetTotalRx();
+    uint64_t attackRx = DynamicCast<PacketSink>(sinkApp.Get(0))->GetTotalRx();
+
+    std::cout << "\n=== VICTIM GOODPUT (" << (mitigate ? "mitigation on" : "mitigation off")
+              << ") ===" << std::endl;
+    std::cout << "Legit rx bytes: " << legitRx << "  goodput "
+              << legitRx * 8.0 / legitSeconds / 1000 << " kbps (offered 500 kbps)" << std::endl;
+    std::cout << "Attack rx bytes: " << attackRx << std::endl;
+
+    if (policer)
+    {
+        std::cout << "Policer: " << policer->GetNFlagged() << " sources flagged, "
+                  << policer->GetNPoliced() << "/" << policer->GetNInspected()
+                  << " packets policed, " << policer->GetCostPerPacketNs()
+                  << " ns per packet (wall clock)" << std::endl;
+    }
+    idsPolicer = nullptr;
+
     Simulator::Destroy();
 
     std::cout << "\nSimulation finished. Total packets captured by IDS: "
               << packetsCaptured << std::endl;
+    PrintIdsReport(attackStart);
+    if (idsSketch)
+    {
+        PrintSketchAccuracy(10);
+    }
 
     return 0;
 }
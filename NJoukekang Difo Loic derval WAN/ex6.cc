@@ -7,82 +7,3157 @@
 #include "ns3/point-to-point-module.h"
 #include "ns3/ipv4-static-routing-helper.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <queue>
+#include <random>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include <malloc.h>
+#include <unistd.h>
+
 using namespace ns3;
 
-NS_LOG_COMPONENT_DEFINE("InterAS_BGP");
+NS_LOG_COMPONENT_DEFINE("InterAS_BGP");
+
+/* ================= BGP DATA ================= */
+
+// Hash-consed immutable value: equal values share one pool entry holding
+// the value and a reference count, and a handle is a single pointer to
+// it. Copying a handle is a counter bump, comparing two is a pointer
+// compare, and the entry goes away with its last handle. Entries of an
+// unordered_map never move, so handles survive rehashing.
+template <class T, class Hash>
+class Interned
+{
+public:
+  Interned() = default;
+  explicit Interned(const T &value) : m_entry(&*Pool().emplace(value, 0).first)
+  {
+    m_entry->second++;
+  }
+
+  Interned(const Interned &o) : m_entry(o.m_entry)
+  {
+    if (m_entry)
+      m_entry->second++;
+  }
+
+  Interned &operator=(const Interned &o)
+  {
+    if (o.m_entry)
+      o.m_entry->second++;
+    Release();
+    m_entry = o.m_entry;
+    return *this;
+  }
+
+  ~Interned()
+  {
+    Release();
+  }
+
+  const T &operator*() const
+  {
+    return m_entry->first;
+  }
+
+  const T *operator->() const
+  {
+    return &m_entry->first;
+  }
+
+  bool operator==(const Interned &o) const
+  {
+    return m_entry == o.m_entry;
+  }
+
+  bool operator!=(const Interned &o) const
+  {
+    return m_entry != o.m_entry;
+  }
+
+  bool IsNull() const
+  {
+    return !m_entry;
+  }
+
+  // Identity of the shared value, for hashing structures that hold handles
+  std::size_t GetId() const
+  {
+    return reinterpret_cast<std::size_t>(m_entry);
+  }
+
+  static std::size_t GetNInterned()
+  {
+    return Pool().size();
+  }
+
+private:
+  using Entry = std::pair<const T, uint32_t>;
+
+  static std::unordered_map<T, uint32_t, Hash> &Pool()
+  {
+    static std::unordered_map<T, uint32_t, Hash> pool;
+    return pool;
+  }
+
+  void Release()
+  {
+    if (m_entry && --m_entry->second == 0)
+      Pool().erase(Pool().find(m_entry->first));
+    m_entry = nullptr;
+  }
+
+  Entry *m_entry = nullptr;
+};
+
+static uint64_t HashCombine(uint64_t h, uint64_t v)
+{
+  h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+  return h;
+}
+
+struct AsnVectorHash
+{
+  std::size_t operator()(const std::vector<uint32_t> &v) const
+  {
+    uint64_t h = v.size();
+    for (uint32_t asn : v)
+      h = HashCombine(h, asn);
+    return h;
+  }
+};
+
+using AsPath = Interned<std::vector<uint32_t>, AsnVectorHash>;
+
+// Path attributes of a route; every route announced with the same set
+// shares one interned copy
+struct BgpAttributes
+{
+  AsPath asPath{std::vector<uint32_t>()};
+  Ipv4Address nextHop{};
+  uint8_t origin = 0; // IGP, EGP, INCOMPLETE
+  uint32_t localPref = 100;
+  uint32_t med = 0;
+  std::vector<uint32_t> communities;
+
+  bool operator==(const BgpAttributes &o) const
+  {
+    return asPath == o.asPath && nextHop == o.nextHop && origin == o.origin &&
+           localPref == o.localPref && med == o.med && communities == o.communities;
+  }
+};
+
+struct BgpAttributesHash
+{
+  std::size_t operator()(const BgpAttributes &a) const
+  {
+    uint64_t h = HashCombine(a.asPath.GetId(), a.nextHop.Get());
+    h = HashCombine(h, (uint64_t(a.origin) << 32) | a.localPref);
+    h = HashCombine(h, a.med);
+    return HashCombine(h, AsnVectorHash()(a.communities));
+  }
+};
+
+using BgpAttrSet = Interned<BgpAttributes, BgpAttributesHash>;
+
+struct BgpRoute
+{
+  BgpRoute() = default;
+  BgpRoute(Ipv4Address p, Ipv4Mask m, const std::vector<uint32_t> &path)
+    : prefix(p), mask(m)
+  {
+    BgpAttributes a;
+    a.asPath = AsPath(path);
+    attrs = BgpAttrSet(a);
+  }
+
+  Ipv4Address prefix;
+  Ipv4Mask mask;
+  BgpAttrSet attrs;
+};
+
+static Ipv4Mask MaskFromLength(uint8_t len)
+{
+  return Ipv4Mask(len == 0 ? 0 : ~uint32_t(0) << (32 - len));
+}
+
+static uint32_t Mix32(uint32_t x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352d;
+  x ^= x >> 15;
+  x *= 0x846ca68b;
+  x ^= x >> 16;
+  return x;
+}
+
+// RIB key: address in the upper bits, prefix length in the low byte
+static uint64_t PrefixKey(Ipv4Address prefix, Ipv4Mask mask)
+{
+  return (uint64_t(prefix.Get()) << 8) | mask.GetPrefixLength();
+}
+
+// RIB table from PrefixKey to V: open addressing with linear probing in
+// one flat slot array and backward-shift deletion, so an entry costs one
+// (key, value) slot instead of a heap node and a bucket pointer. Tables
+// grow at 7/8 full, which keeps a 900k-prefix RIB in 2^20 slots at the
+// price of longer probe runs on a miss.
+template <class V>
+class PrefixMap
+{
+public:
+  V *Find(uint64_t key)
+  {
+    if (m_slots.empty())
+      return nullptr;
+    for (std::size_t i = Home(key);; i = (i + 1) & m_mask)
+    {
+      if (m_slots[i].key == key)
+        return &m_slots[i].value;
+      if (m_slots[i].key == kEmpty)
+        return nullptr;
+    }
+  }
+
+  const V *Find(uint64_t key) const
+  {
+    return const_cast<PrefixMap *>(this)->Find(key);
+  }
+
+  V &operator[](uint64_t key)
+  {
+    if ((m_size + 1) * 8 > m_slots.size() * 7)
+      Rehash(std::max<std::size_t>(16, m_slots.size() * 2));
+    std::size_t i = Home(key);
+    for (; m_slots[i].key != kEmpty; i = (i + 1) & m_mask)
+      if (m_slots[i].key == key)
+        return m_slots[i].value;
+    m_slots[i].key = key;
+    m_size++;
+    return m_slots[i].value;
+  }
+
+  bool Erase(uint64_t key)
+  {
+    if (m_slots.empty())
+      return false;
+    std::size_t i = Home(key);
+    for (; m_slots[i].key != key; i = (i + 1) & m_mask)
+      if (m_slots[i].key == kEmpty)
+        return false;
+
+    // Shift later members of the probe run back over the hole
+    for (std::size_t j = (i + 1) & m_mask; m_slots[j].key != kEmpty; j = (j + 1) & m_mask)
+    {
+      std::size_t home = Home(m_slots[j].key);
+      if (((j - home) & m_mask) >= ((j - i) & m_mask))
+      {
+        m_slots[i] = m_slots[j];
+        i = j;
+      }
+    }
+    m_slots[i] = Slot();
+    m_size--;
+    return true;
+  }
+
+  void Reserve(std::size_t n)
+  {
+    std::size_t capacity = 16;
+    while (capacity * 7 < n * 8)
+      capacity *= 2;
+    if (capacity > m_slots.size())
+      Rehash(capacity);
+  }
+
+  void Clear()
+  {
+    m_slots.clear();
+    m_slots.shrink_to_fit();
+    m_size = 0;
+    m_mask = 0;
+  }
+
+  // Calls f(key, value) for every entry, in no particular order
+  template <class F>
+  void ForEach(F f) const
+  {
+    for (const auto &slot : m_slots)
+      if (slot.key != kEmpty)
+        f(slot.key, slot.value);
+  }
+
+  std::size_t size() const
+  {
+    return m_size;
+  }
+
+  std::size_t GetMemoryBytes() const
+  {
+    return m_slots.capacity() * sizeof(Slot);
+  }
+
+private:
+  static const uint64_t kEmpty = ~uint64_t(0); // prefix length is never 0xff
+
+  struct Slot
+  {
+    uint64_t key = kEmpty;
+    V value;
+  };
+
+  std::size_t Home(uint64_t key) const
+  {
+    return (key * 0x9e3779b97f4a7c15ULL >> 20) & m_mask;
+  }
+
+  void Rehash(std::size_t capacity)
+  {
+    std::vector<Slot> old;
+    old.swap(m_slots);
+    m_slots.resize(capacity);
+    m_mask = capacity - 1;
+    m_size = 0;
+    for (const auto &slot : old)
+      if (slot.key != kEmpty)
+        (*this)[slot.key] = slot.value;
+  }
+
+  std::vector<Slot> m_slots;
+  std::size_t m_size = 0;
+  std::size_t m_mask = 0;
+};
+
+// Values keyed by IPv4 prefix in a path-compressed binary trie: nodes
+// exist only where a value is or where two subtrees branch, and live in
+// one vector with a free list. Every query walks the bits of one address
+// or prefix, so it visits at most 33 nodes whatever the number of entries.
+template <class V>
+class PrefixTrie
+{
+public:
+  // Value stored at prefix/len, default-constructed if new
+  V &Insert(uint32_t prefix, uint8_t len)
+  {
+    prefix &= LengthMask(len);
+    int32_t parent = -1;
+    uint32_t side = 0;
+    for (;;)
+    {
+      int32_t i = Child(parent, side);
+      if (i < 0)
+      {
+        i = NewNode(prefix, len);
+        SetChild(parent, side, i);
+        return Use(i);
+      }
+      uint8_t common = CommonLength(m_nodes[i].prefix, m_nodes[i].len, prefix, len);
+      if (common == m_nodes[i].len && common == len)
+        return Use(i);
+      if (common == m_nodes[i].len)
+      {
+        parent = i;
+        side = Bit(prefix, common);
+        continue;
+      }
+
+      // prefix/len leaves the compressed edge above i: split it at common
+      int32_t fork = NewNode(prefix & LengthMask(common), common);
+      m_nodes[fork].child[Bit(m_nodes[i].prefix, common)] = i;
+      SetChild(parent, side, fork);
+      if (common == len)
+        return Use(fork);
+      int32_t leaf = NewNode(prefix, len);
+      m_nodes[fork].child[Bit(prefix, common)] = leaf;
+      return Use(leaf);
+    }
+  }
+
+  bool Erase(uint32_t prefix, uint8_t len)
+  {
+    prefix &= LengthMask(len);
+    int32_t grandparent = -1;
+    uint32_t parentSide = 0;
+    int32_t parent = -1;
+    uint32_t side = 0;
+    int32_t i = m_root;
+    while (i >= 0 && m_nodes[i].len < len && Covers(m_nodes[i], prefix))
+    {
+      grandparent = parent;
+      parentSide = side;
+      parent = i;
+      side = Bit(prefix, m_nodes[i].len);
+      i = m_nodes[i].child[side];
+    }
+    if (i < 0 || m_nodes[i].len != len || m_nodes[i].prefix != prefix || !m_nodes[i].used)
+      return false;
+
+    m_nodes[i].used = false;
+    m_nodes[i].value = V();
+    m_size--;
+    // Dropping a leaf can leave its parent an unused node with one child
+    if (Prune(parent, side, i) && parent >= 0)
+      Prune(grandparent, parentSide, parent);
+    return true;
+  }
+
+  // Value of the longest prefix covering addr, or nullptr
+  const V *LongestMatch(uint32_t addr) const
+  {
+    const V *best = nullptr;
+    for (int32_t i = m_root; i >= 0;)
+    {
+      const Node &n = m_nodes[i];
+      if (!Covers(n, addr))
+        break;
+      if (n.used)
+        best = &n.value;
+      if (n.len == 32)
+        break;
+      i = n.child[Bit(addr, n.len)];
+    }
+    return best;
+  }
+
+  // Value of the longest prefix covering addr for which usable(value)
+  // holds, or nullptr
+  template <class P>
+  const V *LongestMatch(uint32_t addr, P usable) const
+  {
+    const V *best = nullptr;
+    for (int32_t i = m_root; i >= 0;)
+    {
+      const Node &n = m_nodes[i];
+      if (!Covers(n, addr))
+        break;
+      if (n.used && usable(n.value))
+        best = &n.value;
+      if (n.len == 32)
+        break;
+      i = n.child[Bit(addr, n.len)];
+    }
+    return best;
+  }
+
+  // Calls f(len, value) for every entry covering prefix/len (itself
+  // included), shortest first
+  template <class F>
+  void ForEachCovering(uint32_t prefix, uint8_t len, F f) const
+  {
+    for (int32_t i = m_root; i >= 0;)
+    {
+      const Node &n = m_nodes[i];
+      if (n.len > len || !Covers(n, prefix))
+        break;
+      if (n.used)
+        f(n.len, n.value);
+      if (n.len == len)
+        break;
+      i = n.child[Bit(prefix, n.len)];
+    }
+  }
+
+  // Calls f(prefix, len, value) in address order until it returns false
+  template <class F>
+  void ForEach(F f) const
+  {
+    Walk(m_root, f);
+  }
+
+  std::size_t size() const
+  {
+    return m_size;
+  }
+
+  std::size_t GetNNodes() const
+  {
+    return m_nodes.size() - m_free.size();
+  }
+
+  std::size_t GetMemoryBytes() const
+  {
+    return m_nodes.capacity() * sizeof(Node) + m_free.capacity() * sizeof(int32_t);
+  }
+
+private:
+  struct Node
+  {
+    uint32_t prefix;
+    uint8_t len;
+    bool used = false; // false: branch point only
+    int32_t child[2] = {-1, -1};
+    V value{};
+  };
+
+  static uint32_t LengthMask(uint8_t len)
+  {
+    return len == 0 ? 0 : ~uint32_t(0) << (32 - len);
+  }
+
+  static uint32_t Bit(uint32_t addr, uint8_t pos)
+  {
+    return (addr >> (31 - pos)) & 1;
+  }
+
+  static uint8_t CommonLength(uint32_t a, uint8_t aLen, uint32_t b, uint8_t bLen)
+  {
+    uint32_t diff = a ^ b;
+    uint8_t common = diff ? __builtin_clz(diff) : 32;
+    return std::min({common, aLen, bLen});
+  }
+
+  static bool Covers(const Node &n, uint32_t addr)
+  {
+    return ((addr ^ n.prefix) & LengthMask(n.len)) == 0;
+  }
+
+  int32_t Child(int32_t parent, uint32_t side) const
+  {
+    return parent < 0 ? m_root : m_nodes[parent].child[side];
+  }
+
+  void SetChild(int32_t parent, uint32_t side, int32_t i)
+  {
+    if (parent < 0)
+      m_root = i;
+    else
+      m_nodes[parent].child[side] = i;
+  }
+
+  int32_t NewNode(uint32_t prefix, uint8_t len)
+  {
+    Node n;
+    n.prefix = prefix;
+    n.len = len;
+    if (!m_free.empty())
+    {
+      int32_t i = m_free.back();
+      m_free.pop_back();
+      m_nodes[i] = n;
+      return i;
+    }
+    m_nodes.push_back(n);
+    return m_nodes.size() - 1;
+  }
+
+  V &Use(int32_t i)
+  {
+    if (!m_nodes[i].used)
+    {
+      m_nodes[i].used = true;
+      m_size++;
+    }
+    return m_nodes[i].value;
+  }
+
+  // Unlinks node i (reached from parent/side) if it is unused and has at
+  // most one child; returns true if it did
+  bool Prune(int32_t parent, uint32_t side, int32_t i)
+  {
+    const Node &n = m_nodes[i];
+    if (n.used || (n.child[0] >= 0 && n.child[1] >= 0))
+      return false;
+    SetChild(parent, side, n.child[0] >= 0 ? n.child[0] : n.child[1]);
+    m_free.push_back(i);
+    return true;
+  }
+
+  template <class F>
+  bool Walk(int32_t i, F &f) const
+  {
+    if (i < 0)
+      return true;
+    const Node &n = m_nodes[i];
+    if (n.used && !f(n.prefix, n.len, n.value))
+      return false;
+    return Walk(n.child[0], f) && Walk(n.child[1], f);
+  }
+
+  std::vector<Node> m_nodes;
+  std::vector<int32_t> m_free; // recycled node indices
+  int32_t m_root = -1;
+  std::size_t m_size = 0;
+};
+
+/* ================= BGP WIRE FORMAT ================= */
+
+// RFC 4271 message layout: 16-byte marker, 2-byte length, 1-byte type.
+// AS_PATH carries 4-octet AS numbers, as after RFC 6793 capability
+// negotiation.
+enum BgpMessageType : uint8_t
+{
+  BGP_OPEN = 1,
+  BGP_UPDATE = 2,
+  BGP_NOTIFICATION = 3,
+  BGP_KEEPALIVE = 4
+};
+
+static const uint32_t kBgpHeaderSize = 19;
+static const uint32_t kBgpMaxMessageSize = 4096;
+static const uint16_t kBgpPort = 179;
+
+static void PutU16(std::vector<uint8_t> &b, uint16_t v)
+{
+  b.push_back(v >> 8);
+  b.push_back(v & 0xff);
+}
+
+static void PutU32(std::vector<uint8_t> &b, uint32_t v)
+{
+  PutU16(b, v >> 16);
+  PutU16(b, v & 0xffff);
+}
+
+static void PutPrefix(std::vector<uint8_t> &b, Ipv4Address prefix, Ipv4Mask mask)
+{
+  uint8_t len = mask.GetPrefixLength();
+  b.push_back(len);
+  uint32_t a = prefix.Get();
+  for (uint32_t i = 0; i < (len + 7u) / 8; ++i)
+    b.push_back(a >> (24 - 8 * i));
+}
+
+// Bounds-checked reader over a received message body
+struct BgpReader
+{
+  const uint8_t *p;
+  const uint8_t *end;
+  bool ok = true;
+
+  bool Need(uint32_t n)
+  {
+    if (end - p < std::ptrdiff_t(n))
+      ok = false;
+    return ok;
+  }
+
+  uint8_t U8()
+  {
+    return Need(1) ? *p++ : 0;
+  }
+
+  uint16_t U16()
+  {
+    if (!Need(2))
+      return 0;
+    uint16_t v = (uint16_t(p[0]) << 8) | p[1];
+    p += 2;
+    return v;
+  }
+
+  uint32_t U32()
+  {
+    uint32_t hi = U16();
+    return (hi << 16) | U16();
+  }
+
+  void Prefix(Ipv4Address &prefix, Ipv4Mask &mask)
+  {
+    uint8_t len = U8();
+    if (len > 32 || !Need((len + 7u) / 8))
+    {
+      ok = false;
+      return;
+    }
+    uint32_t a = 0;
+    for (uint32_t i = 0; i < (len + 7u) / 8; ++i)
+      a |= uint32_t(*p++) << (24 - 8 * i);
+    mask = MaskFromLength(len);
+    prefix = Ipv4Address(a & mask.Get());
+  }
+};
+
+/* ================= BGP FIB ================= */
+
+// Forwarding table for BGP-installed routes. It sits in the node's
+// Ipv4ListRouting below static routing, so connected and intra-AS routes
+// still win. Routes are kept in a PrefixTrie, so a lookup visits at most
+// 33 nodes whatever the table size, where Ipv4StaticRouting scans its
+// whole route list for every packet.
+class BgpFibRouting : public Ipv4RoutingProtocol
+{
+public:
+  static TypeId GetTypeId()
+  {
+    static TypeId tid = TypeId("BgpFibRouting")
+      .SetParent<Ipv4RoutingProtocol>()
+      .AddConstructor<BgpFibRouting>();
+    return tid;
+  }
+
+  // Adds or replaces the route to net/mask
+  void AddRoute(Ipv4Address net, Ipv4Mask mask, Ipv4Address nextHop, uint32_t interface)
+  {
+    m_routes.Insert(net.Get(), mask.GetPrefixLength()) = {nextHop.Get(), interface};
+  }
+
+  bool RemoveRoute(Ipv4Address net, Ipv4Mask mask)
+  {
+    return m_routes.Erase(net.Get(), mask.GetPrefixLength());
+  }
+
+  // Longest-prefix match; false if no route covers dst
+  bool Lookup(Ipv4Address dst, Ipv4Address &nextHop, uint32_t &interface) const
+  {
+    const FibEntry *e = m_routes.LongestMatch(dst.Get());
+    if (!e)
+      return false;
+    nextHop = Ipv4Address(e->nextHop);
+    interface = e->interface;
+    return true;
+  }
+
+  uint32_t GetNRoutes() const
+  {
+    return m_routes.size();
+  }
+
+  std::size_t GetNNodes() const
+  {
+    return m_routes.GetNNodes();
+  }
+
+  std::size_t GetMemoryBytes() const
+  {
+    return m_routes.GetMemoryBytes();
+  }
+
+  Ptr<Ipv4Route> RouteOutput(Ptr<Packet>, const Ipv4Header &header, Ptr<NetDevice> oif,
+                             Socket::SocketErrno &sockerr) override
+  {
+    Ptr<Ipv4Route> route = MakeRoute(header.GetDestination(), oif);
+    sockerr = route ? Socket::ERROR_NOTERROR : Socket::ERROR_NOROUTETOHOST;
+    return route;
+  }
+
+  // Ipv4ListRouting has already handled local delivery, multicast and
+  // interfaces that do not forward
+  bool RouteInput(Ptr<const Packet> p, const Ipv4Header &header, Ptr<const NetDevice>,
+                  const UnicastForwardCallback &ucb, const MulticastForwardCallback &,
+                  const LocalDeliverCallback &, const ErrorCallback &) override
+  {
+    Ptr<Ipv4Route> route = MakeRoute(header.GetDestination(), nullptr);
+    if (!route)
+      return false;
+    ucb(route, p, header);
+    return true;
+  }
+
+  // Routes stay installed while their interface is down (MakeRoute falls
+  // back to a less specific one); BGP withdraws them when the session drops
+  void NotifyInterfaceUp(uint32_t) override {}
+  void NotifyInterfaceDown(uint32_t) override {}
+  void NotifyAddAddress(uint32_t, Ipv4InterfaceAddress) override {}
+  void NotifyRemoveAddress(uint32_t, Ipv4InterfaceAddress) override {}
+
+  void SetIpv4(Ptr<Ipv4> ipv4) override
+  {
+    m_ipv4 = ipv4;
+  }
+
+  void PrintRoutingTable(Ptr<OutputStreamWrapper> stream, Time::Unit unit = Time::S) const override
+  {
+    std::ostream &os = *stream->GetStream();
+    os << "Node: " << m_ipv4->GetObject<Node>()->GetId() << ", Time: " << Simulator::Now().As(unit)
+       << ", BgpFibRouting table (" << m_routes.size() << " routes)" << std::endl;
+    os << "Destination     Gateway         Genmask         Iface" << std::endl;
+    std::size_t printed = 0;
+    m_routes.ForEach([&](uint32_t prefix, uint8_t len, const FibEntry &e) {
+      std::ostringstream dest, gw, mask;
+      dest << Ipv4Address(prefix);
+      gw << Ipv4Address(e.nextHop);
+      mask << MaskFromLength(len);
+      os << std::left << std::setw(16) << dest.str() << std::setw(16) << gw.str() << std::setw(16)
+         << mask.str() << e.interface << std::right << std::endl;
+      return ++printed < kMaxPrinted;
+    });
+    if (m_routes.size() > kMaxPrinted)
+      os << "... " << m_routes.size() - kMaxPrinted << " more" << std::endl;
+    os << std::endl;
+  }
+
+private:
+  static const std::size_t kMaxPrinted = 20;
+
+  struct FibEntry
+  {
+    uint32_t nextHop;
+    uint32_t interface;
+  };
+
+  Ptr<Ipv4Route> MakeRoute(Ipv4Address dst, Ptr<NetDevice> oif) const
+  {
+    // Longest match whose interface is up (and is oif, if given)
+    const FibEntry *e = m_routes.LongestMatch(dst.Get(), [this, &oif](const FibEntry &f) {
+      return m_ipv4->IsUp(f.interface) && (!oif || oif == m_ipv4->GetNetDevice(f.interface));
+    });
+    if (!e)
+      return nullptr;
+    Ptr<NetDevice> dev = m_ipv4->GetNetDevice(e->interface);
+    Ptr<Ipv4Route> route = Create<Ipv4Route>();
+    route->SetDestination(dst);
+    route->SetGateway(Ipv4Address(e->nextHop));
+    route->SetOutputDevice(dev);
+    route->SetSource(m_ipv4->SourceAddressSelection(e->interface, dst));
+    return route;
+  }
+
+  void DoDispose() override
+  {
+    m_ipv4 = nullptr;
+    Ipv4RoutingProtocol::DoDispose();
+  }
+
+  Ptr<Ipv4> m_ipv4;
+  PrefixTrie<FibEntry> m_routes;
+};
+
+/* ================= AS RELATIONSHIPS ================= */
+
+// What a neighbor AS is to us
+enum BgpRelationship : uint8_t
+{
+  BGP_CUSTOMER,
+  BGP_PEER,
+  BGP_PROVIDER,
+  BGP_UNKNOWN
+};
+
+// Business relationships between AS pairs, as published in CAIDA's as-rel
+// data. Speakers use them to check that received AS_PATHs are valley-free.
+class AsRelationships
+{
+public:
+  void AddProviderCustomer(uint32_t provider, uint32_t customer)
+  {
+    m_rel[Key(provider, customer)] = BGP_CUSTOMER;
+    m_rel[Key(customer, provider)] = BGP_PROVIDER;
+  }
+
+  void AddPeers(uint32_t a, uint32_t b)
+  {
+    m_rel[Key(a, b)] = BGP_PEER;
+    m_rel[Key(b, a)] = BGP_PEER;
+  }
+
+  // What b is to a
+  BgpRelationship Get(uint32_t a, uint32_t b) const
+  {
+    auto it = m_rel.find(Key(a, b));
+    return it == m_rel.end() ? BGP_UNKNOWN : it->second;
+  }
+
+  std::size_t size() const
+  {
+    return m_rel.size() / 2;
+  }
+
+private:
+  static uint64_t Key(uint32_t a, uint32_t b)
+  {
+    return (uint64_t(a) << 32) | b;
+  }
+
+  std::unordered_map<uint64_t, BgpRelationship> m_rel;
+};
+
+/* ================= ROUTE ORIGIN VALIDATION ================= */
+
+enum RpkiState : uint8_t
+{
+  RPKI_NOT_FOUND,
+  RPKI_VALID,
+  RPKI_INVALID
+};
+
+// Validated ROA payloads (prefix, maximum length, origin AS), as exported
+// by an RPKI relying-party cache such as Routinator or rpki-client. They
+// are indexed by prefix in a PrefixTrie, so validating a route walks the
+// bits of its prefix once: O(prefix length) whatever the number of ROAs.
+class RoaTable
+{
+public:
+  void Add(Ipv4Address prefix, uint8_t len, uint8_t maxLength, uint32_t asn)
+  {
+    RoaList &list = m_index.Insert(prefix.Get(), len);
+    m_roas.push_back({asn, maxLength, list.first});
+    list.first = m_roas.size() - 1;
+  }
+
+  // One ROA per line, fields separated by commas or blanks ('#' starts a
+  // comment): "ASN prefix/len [maxLength ...]", the ASN with or without
+  // "AS" in front. The CSV header and IPv6 ROAs are skipped.
+  void LoadFile(const std::string &path)
+  {
+    std::ifstream in(path);
+    if (!in)
+      NS_FATAL_ERROR("Cannot open ROA file " << path);
+
+    std::string line;
+    uint32_t lineNo = 0;
+    while (std::getline(in, line))
+    {
+      lineNo++;
+      line = line.substr(0, line.find('#'));
+      std::replace(line.begin(), line.end(), ',', ' ');
+      std::istringstream fields(line);
+      std::string asn, prefix;
+      if (!(fields >> asn >> prefix) || asn == "ASN" || prefix.find(':') != std::string::npos)
+        continue;
+      if (asn.compare(0, 2, "AS") == 0)
+        asn = asn.substr(2);
+
+      std::size_t slash = prefix.find('/');
+      uint32_t len = slash == std::string::npos ? 33 : std::atoi(prefix.c_str() + slash + 1);
+      uint32_t maxLength = len;
+      fields >> maxLength;
+      if (asn.empty() || asn.find_first_not_of("0123456789") != std::string::npos || len > 32 ||
+          maxLength < len || maxLength > 32)
+        NS_FATAL_ERROR(path << ":" << lineNo << ": malformed ROA");
+      Add(Ipv4Address(prefix.substr(0, slash).c_str()), len, maxLength, std::stoul(asn));
+    }
+  }
+
+  // RFC 6811: NOT_FOUND if no ROA covers the prefix, VALID if one of those
+  // that do names the origin AS and allows the prefix length, otherwise
+  // INVALID. AS 0 ROAs never match.
+  RpkiState Validate(Ipv4Address prefix, uint8_t len, uint32_t origin) const
+  {
+    RpkiState state = RPKI_NOT_FOUND;
+    m_index.ForEachCovering(prefix.Get(), len, [&](uint8_t, const RoaList &list) {
+      for (int32_t i = list.first; i >= 0 && state != RPKI_VALID; i = m_roas[i].next)
+        state = origin != 0 && m_roas[i].asn == origin && len <= m_roas[i].maxLength ? RPKI_VALID : RPKI_INVALID;
+    });
+    return state;
+  }
+
+  std::size_t size() const
+  {
+    return m_roas.size();
+  }
+
+  std::size_t GetMemoryBytes() const
+  {
+    return m_index.GetMemoryBytes() + m_roas.capacity() * sizeof(Roa);
+  }
+
+private:
+  struct Roa
+  {
+    uint32_t asn;
+    uint8_t maxLength;
+    int32_t next; // next ROA for the same prefix, or -1
+  };
+
+  struct RoaList
+  {
+    int32_t first = -1;
+  };
+
+  PrefixTrie<RoaList> m_index;
+  std::vector<Roa> m_roas;
+};
+
+/* ================= BGP SPEAKER ================= */
+
+struct BgpStats
+{
+  uint64_t messagesSent[5] = {0, 0, 0, 0, 0}; // indexed by BgpMessageType
+  uint64_t bytesSent = 0;
+  uint64_t prefixesSent = 0;    // announced or withdrawn
+  uint64_t messagesReceived = 0;
+  uint64_t bytesReceived = 0;
+  uint64_t prefixesReceived = 0;
+  uint64_t updatesReceived = 0;
+  uint64_t updateWallNs = 0;    // wall-clock time spent processing UPDATEs
+  uint64_t decisions = 0;       // prefixes run through the decision process
+  uint64_t bestPathChanges = 0;
+  uint64_t routeChanges = 0;    // FIB installs and removals
+  uint64_t leakUpdates = 0;     // UPDATEs whose AS_PATH is not valley-free
+  uint64_t leakedPrefixes = 0;
+  uint64_t rpki[3] = {0, 0, 0}; // received prefixes by RpkiState
+  uint64_t rpkiWallNs = 0;      // wall-clock time spent validating them
+  uint64_t suppressions = 0;    // routes suppressed by flap damping
+  uint64_t reuses = 0;          // and released again
+  Time lastBestPathChange;
+  Time lastRouteChange;
+  Time firstLeak = Time::Max();
+};
+
+// BGP-4 speaker for a border router. Each eBGP neighbor sits across a
+// directly connected link (an IXP); the session runs over TCP port 179,
+// opened by the side with the lower address, and goes through
+// OPEN -> KEEPALIVE -> Established before routes are exchanged.
+//
+// Received routes land in the neighbor's Adj-RIB-In. Every prefix an
+// UPDATE touches is re-run through the decision process, and only those
+// prefixes; a change of best path updates the Loc-RIB, the node's BGP FIB
+// (towards the NEXT_HOP of the best route) and each neighbor's
+// Adj-RIB-Out, which holds what that neighbor was last told so only real
+// changes are sent.
+//
+// Neighbors are customers, peers or providers. Exports follow the
+// Gao-Rexford rules (routes from peers and providers go to customers only)
+// and every received AS_PATH is checked against them: with the
+// relationships of the ASes along it, a path must climb customer-to-
+// provider links, cross at most one peer link and then only descend.
+// A path that does not is a route leak; it is counted and, with
+// RejectLeaks, dropped. The check runs once per UPDATE, whatever the
+// number of prefixes it carries. Given a RoaTable, every received prefix
+// is also validated against its origin AS, and with RejectInvalid the
+// RPKI-invalid ones are dropped.
+//
+// With Damping, routes that flap are suppressed as in RFC 2439: each
+// withdrawal and attribute change adds to a per-neighbor, per-prefix
+// penalty that halves every DampingHalfLife; above DampingSuppress the
+// route stays in the Adj-RIB-In but is left out of the decision process
+// until the penalty has decayed below DampingReuse. The history of a
+// prefix is forgotten once its penalty falls below half of DampingReuse.
+class BgpSpeaker : public Application
+{
+public:
+  static TypeId GetTypeId()
+  {
+    static TypeId tid = TypeId("BgpSpeaker")
+      .SetParent<Application>()
+      .AddConstructor<BgpSpeaker>()
+      .AddAttribute("Asn", "Autonomous system number",
+                    UintegerValue(0),
+                    MakeUintegerAccessor(&BgpSpeaker::m_as),
+                    MakeUintegerChecker<uint32_t>())
+      .AddAttribute("HoldTime", "Hold time offered in OPEN; KEEPALIVEs go out every third of it",
+                    TimeValue(Seconds(90)),
+                    MakeTimeAccessor(&BgpSpeaker::m_holdTime),
+                    MakeTimeChecker())
+      .AddAttribute("ConnectRetry", "Delay before retrying a failed or closed session",
+                    TimeValue(Seconds(1)),
+                    MakeTimeAccessor(&BgpSpeaker::m_connectRetry),
+                    MakeTimeChecker())
+      .AddAttribute("InstallRoutes", "Install best paths in the node's BGP FIB",
+                    BooleanValue(true),
+                    MakeBooleanAccessor(&BgpSpeaker::m_installRoutes),
+                    MakeBooleanChecker())
+      .AddAttribute("ValleyFree", "Export routes from peers and providers to customers only",
+                    BooleanValue(true),
+                    MakeBooleanAccessor(&BgpSpeaker::m_valleyFree),
+                    MakeBooleanChecker())
+      .AddAttribute("RejectLeaks", "Drop received routes whose AS_PATH is not valley-free",
+                    BooleanValue(false),
+                    MakeBooleanAccessor(&BgpSpeaker::m_rejectLeaks),
+                    MakeBooleanChecker())
+      .AddAttribute("Mrai", "MinRouteAdvertisementInterval: least time between two UPDATE bursts to a neighbor",
+                    TimeValue(Seconds(0)),
+                    MakeTimeAccessor(&BgpSpeaker::m_mrai),
+                    MakeTimeChecker())
+      .AddAttribute("Batching", "Coalesce changes per neighbor and pack prefixes into UPDATEs; "
+                    "false sends one UPDATE per prefix and change, at once",
+                    BooleanValue(true),
+                    MakeBooleanAccessor(&BgpSpeaker::m_batching),
+                    MakeBooleanChecker())
+      .AddAttribute("RejectInvalid", "Drop received routes that RPKI origin validation finds invalid",
+                    BooleanValue(false),
+                    MakeBooleanAccessor(&BgpSpeaker::m_rejectInvalid),
+                    MakeBooleanChecker())
+      .AddAttribute("Damping", "Suppress flapping routes (RFC 2439 route flap damping)",
+                    BooleanValue(false),
+                    MakeBooleanAccessor(&BgpSpeaker::m_damping),
+                    MakeBooleanChecker())
+      .AddAttribute("DampingHalfLife", "Time for a flap penalty to decay by half",
+                    TimeValue(Minutes(15)),
+                    MakeTimeAccessor(&BgpSpeaker::m_halfLife),
+                    MakeTimeChecker())
+      .AddAttribute("DampingSuppress", "Penalty above which a route is suppressed",
+                    DoubleValue(2000),
+                    MakeDoubleAccessor(&BgpSpeaker::m_suppressLimit),
+                    MakeDoubleChecker<double>(0))
+      .AddAttribute("DampingReuse", "Penalty below which a suppressed route is used again",
+                    DoubleValue(750),
+                    MakeDoubleAccessor(&BgpSpeaker::m_reuseLimit),
+                    MakeDoubleChecker<double>(1))
+      .AddAttribute("DampingMaxSuppress", "Longest a route stays suppressed after its last flap",
+                    TimeValue(Minutes(60)),
+                    MakeTimeAccessor(&BgpSpeaker::m_maxSuppress),
+                    MakeTimeChecker());
+    return tid;
+  }
+
+  // eBGP neighbor reachable over a directly connected link. Routes learned
+  // from it get localPref (import policy); 0 picks the usual preference
+  // for the relationship: customer 120, peer 100, provider 80.
+  void AddNeighbor(uint32_t asn, Ipv4Address peerAddress, BgpRelationship relationship = BGP_PEER,
+                   uint32_t localPref = 0)
+  {
+    static const uint32_t kDefaultLocalPref[] = {120, 100, 80, 100};
+    BgpSession s;
+    s.peerAs = asn;
+    s.peerAddress = peerAddress;
+    s.relationship = relationship;
+    s.localPref = localPref ? localPref : kDefaultLocalPref[relationship];
+    m_sessions.push_back(s);
+  }
+
+  // Relationships between other ASes, for checking received AS_PATHs
+  // beyond the first hop; db must outlive the speaker
+  void SetAsRelationships(const AsRelationships *db)
+  {
+    m_relationships = db;
+  }
+
+  // ROAs to validate received routes against; roas must outlive the speaker
+  void SetRoaTable(const RoaTable *roas)
+  {
+    m_roas = roas;
+  }
+
+  // Re-runs the export policy for every prefix, e.g. after ValleyFree
+  // has been changed
+  void RefreshExports()
+  {
+    for (uint32_t i = 0; i < m_sessions.size(); ++i)
+      m_locRib.ForEach([&](uint64_t key, const LocRibEntry &) { Advertise(m_sessions[i], i, key); });
+  }
+
+  // Adds (or replaces) a locally originated route; it wins the decision
+  // process for its prefix and is announced to every neighbor.
+  void Originate(const BgpRoute &r)
+  {
+    NS_LOG_INFO("[BGP] AS" << m_as << " originates "
+                << r.prefix << "/" << r.mask.GetPrefixLength());
+    uint64_t key = PrefixKey(r.prefix, r.mask);
+    m_localRib[key] = r.attrs;
+    Decide(key);
+  }
+
+  // Bulk origination, e.g. a full table redistributed from an upstream feed
+  void Originate(const std::vector<BgpRoute> &routes)
+  {
+    NS_LOG_INFO("[BGP] AS" << m_as << " originates " << routes.size() << " prefixes");
+    m_localRib.Reserve(m_localRib.size() + routes.size());
+    m_locRib.Reserve(m_locRib.size() + routes.size());
+    for (const auto &r : routes)
+    {
+      uint64_t key = PrefixKey(r.prefix, r.mask);
+      m_localRib[key] = r.attrs;
+      Decide(key);
+    }
+  }
+
+  void Withdraw(Ipv4Address prefix, Ipv4Mask mask)
+  {
+    uint64_t key = PrefixKey(prefix, mask);
+    if (m_localRib.Erase(key))
+      Decide(key);
+  }
+
+  void InstallRoute(Ipv4Address net, Ipv4Mask mask, Ipv4Address nextHop)
+  {
+    // HandleUpdate only accepts next hops on connected links, but one can
+    // go away with an address change
+    int32_t interface = InterfaceFor(nextHop, nullptr);
+    if (interface < 0)
+    {
+      NS_LOG_INFO("[BGP] AS" << m_as << " next hop " << nextHop << " for " << net << " is not connected");
+      RemoveRoute(net, mask);
+      return;
+    }
+
+    GetFib()->AddRoute(net, mask, nextHop, interface);
+    m_stats.routeChanges++;
+    m_stats.lastRouteChange = Simulator::Now();
+  }
+
+  void RemoveRoute(Ipv4Address net, Ipv4Mask mask)
+  {
+    if (!GetFib()->RemoveRoute(net, mask))
+      return;
+    m_stats.routeChanges++;
+    m_stats.lastRouteChange = Simulator::Now();
+  }
+
+  // The node's BGP FIB, added to its Ipv4ListRouting on first use
+  Ptr<BgpFibRouting> GetFib()
+  {
+    if (m_fib)
+      return m_fib;
+    Ptr<Ipv4ListRouting> list = DynamicCast<Ipv4ListRouting>(GetNode()->GetObject<Ipv4>()->GetRoutingProtocol());
+    NS_ABORT_MSG_IF(!list, "Node " << GetNode()->GetId() << " does not use Ipv4ListRouting");
+    for (uint32_t i = 0; i < list->GetNRoutingProtocols() && !m_fib; ++i)
+    {
+      int16_t priority;
+      m_fib = DynamicCast<BgpFibRouting>(list->GetRoutingProtocol(i, priority));
+    }
+    if (!m_fib)
+    {
+      m_fib = CreateObject<BgpFibRouting>();
+      list->AddRoutingProtocol(m_fib, -5); // static routing has priority 0
+    }
+    return m_fib;
+  }
+
+  uint32_t GetAsn() const
+  {
+    return m_as;
+  }
+
+  const BgpStats &GetStats() const
+  {
+    return m_stats;
+  }
+
+  uint32_t GetNEstablished() const
+  {
+    uint32_t n = 0;
+    for (const auto &s : m_sessions)
+      n += s.state == ESTABLISHED;
+    return n;
+  }
+
+  std::size_t GetLocRibSize() const
+  {
+    return m_locRib.size();
+  }
+
+  std::size_t GetAdjRibInSize() const
+  {
+    std::size_t n = 0;
+    for (const auto &s : m_sessions)
+      n += s.ribIn.size();
+    return n;
+  }
+
+  // Routes currently held back by flap damping
+  std::size_t GetNSuppressed() const
+  {
+    std::size_t n = 0;
+    for (const auto &s : m_sessions)
+      s.damping.ForEach([&n](uint64_t, const DampingState &d) { n += d.suppressed; });
+    return n;
+  }
+
+  std::size_t GetAdjRibOutSize() const
+  {
+    std::size_t n = 0;
+    for (const auto &s : m_sessions)
+      n += s.ribOut.size();
+    return n;
+  }
+
+  // Bytes held by the RIB tables (the interned attributes are shared)
+  std::size_t GetRibMemoryBytes() const
+  {
+    std::size_t n = m_localRib.GetMemoryBytes() + m_locRib.GetMemoryBytes();
+    for (const auto &s : m_sessions)
+      n += s.ribIn.GetMemoryBytes() + s.ribOut.GetMemoryBytes();
+    return n;
+  }
+
+  void PrintLocRib(std::ostream &os, std::size_t maxEntries = 20) const
+  {
+    std::map<uint64_t, const LocRibEntry *> sorted;
+    m_locRib.ForEach([&](uint64_t key, const LocRibEntry &e) { sorted[key] = &e; });
+
+    os << "Loc-RIB of AS" << m_as << " (node " << GetNode()->GetId() << ")" << std::endl;
+    std::size_t printed = 0;
+    for (const auto &e : sorted)
+    {
+      if (printed++ == maxEntries)
+      {
+        os << "  ... " << sorted.size() - maxEntries << " more" << std::endl;
+        break;
+      }
+      const BgpAttributes &a = *e.second->attrs;
+      os << "  " << Ipv4Address(uint32_t(e.first >> 8)) << "/" << (e.first & 0xff) << " via ";
+      if (e.second->from == kLocal)
+        os << "local";
+      else
+        os << a.nextHop;
+      os << " lp " << a.localPref << " med " << a.med << " path";
+      for (uint32_t asn : *a.asPath)
+        os << " " << asn;
+      os << std::endl;
+    }
+  }
+
+private:
+  enum SessionState
+  {
+    IDLE,
+    CONNECT,
+    OPEN_SENT,
+    OPEN_CONFIRM,
+    ESTABLISHED
+  };
+
+  // Flap history of one prefix from one neighbor. The penalty is only
+  // brought up to date when it is looked at: penalty * 2^-(now - updated)
+  // / half-life.
+  struct DampingState
+  {
+    double penalty = 0;
+    Time updated;
+    bool suppressed = false;
+    Time due = Time::Max(); // when the reuse queue looks at it next
+  };
+
+  struct BgpSession
+  {
+    uint32_t peerAs = 0;
+    uint32_t peerId = 0; // BGP identifier from the peer's OPEN
+    uint32_t localPref = 100;
+    BgpRelationship relationship = BGP_PEER;
+    Ipv4Address peerAddress;
+    Ipv4Address localAddress;
+    bool active = false; // we open the TCP connection
+    SessionState state = IDLE;
+    Ptr<Socket> socket;
+    std::vector<uint8_t> rxBuffer;
+    std::vector<uint8_t> txBuffer;
+    std::size_t txOffset = 0;
+    Time holdTime;
+    EventId keepaliveEvent;
+    EventId holdEvent;
+    EventId retryEvent;
+    EventId mraiEvent;             // pending flush or running MRAI timer
+    std::vector<uint64_t> pending; // prefixes to re-export at the next flush
+    PrefixMap<BgpAttrSet> ribIn;  // Adj-RIB-In: accepted routes by prefix
+    PrefixMap<BgpAttrSet> ribOut; // Adj-RIB-Out: routes as last sent
+    PrefixMap<DampingState> damping; // prefixes that have flapped
+  };
+
+  static const int32_t kLocal = -1;
+
+  struct LocRibEntry
+  {
+    BgpAttrSet attrs;
+    int32_t from = kLocal; // session index, or kLocal
+  };
+
+  void StartApplication() override
+  {
+    NS_ABORT_MSG_IF(m_damping && m_suppressLimit <= m_reuseLimit,
+                    "AS" << m_as << ": DampingSuppress must be above DampingReuse");
+    m_listener = Socket::CreateSocket(GetNode(), TcpSocketFactory::GetTypeId());
+    m_listener->Bind(InetSocketAddress(Ipv4Address::GetAny(), kBgpPort));
+    m_listener->Listen();
+    m_listener->SetAcceptCallback(MakeCallback(&BgpSpeaker::HandleConnectionRequest, this),
+                                  MakeCallback(&BgpSpeaker::HandleAccept, this));
+
+    for (auto &s : m_sessions)
+    {
+      NS_ABORT_MSG_IF(InterfaceFor(s.peerAddress, &s.localAddress) < 0,
+                      "AS" << m_as << ": BGP neighbor " << s.peerAddress << " is not directly connected");
+      // Collision avoidance: only the lower address opens the connection
+      s.active = s.localAddress < s.peerAddress;
+      if (s.active)
+        Connect(s);
+    }
+  }
+
+  void StopApplication() override
+  {
+    m_stopping = true;
+    m_reuseEvent.Cancel();
+    for (auto &s : m_sessions)
+    {
+      s.retryEvent.Cancel();
+      CloseSession(s, false);
+    }
+    if (m_listener)
+    {
+      m_listener->Close();
+      m_listener = nullptr;
+    }
+  }
+
+  // Interface whose subnet contains addr; also returns our address on it
+  int32_t InterfaceFor(Ipv4Address addr, Ipv4Address *local) const
+  {
+    Ptr<Ipv4> ipv4 = GetNode()->GetObject<Ipv4>();
+    for (uint32_t i = 0; i < ipv4->GetNInterfaces(); ++i)
+      for (uint32_t j = 0; j < ipv4->GetNAddresses(i); ++j)
+      {
+        Ipv4InterfaceAddress ifAddr = ipv4->GetAddress(i, j);
+        if (ifAddr.GetMask().IsMatch(ifAddr.GetLocal(), addr))
+        {
+          if (local)
+            *local = ifAddr.GetLocal();
+          return i;
+        }
+      }
+    return -1;
+  }
+
+  BgpSession *FindSession(Ptr<Socket> socket)
+  {
+    for (auto &s : m_sessions)
+      if (s.socket == socket)
+        return &s;
+    return nullptr;
+  }
+
+  /* ---------- Transport ---------- */
+
+  void Connect(BgpSession &s)
+  {
+    s.socket = Socket::CreateSocket(GetNode(), TcpSocketFactory::GetTypeId());
+    s.socket->Bind(InetSocketAddress(s.localAddress, 0));
+    s.socket->SetConnectCallback(MakeCallback(&BgpSpeaker::HandleConnected, this),
+                                 MakeCallback(&BgpSpeaker::HandleConnectFailed, this));
+    s.socket->Connect(InetSocketAddress(s.peerAddress, kBgpPort));
+    s.state = CONNECT;
+  }
+
+  bool HandleConnectionRequest(Ptr<Socket>, const Address &from)
+  {
+    Ipv4Address peer = InetSocketAddress::ConvertFrom(from).GetIpv4();
+    for (const auto &s : m_sessions)
+      if (s.peerAddress == peer && !s.active && s.state == IDLE)
+        return true;
+    return false;
+  }
+
+  void HandleAccept(Ptr<Socket> socket, const Address &from)
+  {
+    Ipv4Address peer = InetSocketAddress::ConvertFrom(from).GetIpv4();
+    for (auto &s : m_sessions)
+      if (s.peerAddress == peer && !s.active)
+      {
+        s.socket = socket;
+        SessionUp(s);
+        return;
+      }
+  }
+
+  void HandleConnected(Ptr<Socket> socket)
+  {
+    if (BgpSession *s = FindSession(socket))
+      SessionUp(*s);
+  }
+
+  void HandleConnectFailed(Ptr<Socket> socket)
+  {
+    if (BgpSession *s = FindSession(socket))
+      CloseSession(*s, true);
+  }
+
+  void HandleClose(Ptr<Socket> socket)
+  {
+    if (BgpSession *s = FindSession(socket))
+    {
+      NS_LOG_INFO("[BGP] AS" << m_as << " session to AS" << s->peerAs << " closed by peer");
+      CloseSession(*s, true);
+    }
+  }
+
+  // TCP is up: send OPEN and wait for the peer's
+  void SessionUp(BgpSession &s)
+  {
+    s.socket->SetRecvCallback(MakeCallback(&BgpSpeaker::HandleRead, this));
+    s.socket->SetSendCallback(MakeCallback(&BgpSpeaker::HandleSend, this));
+    s.socket->SetCloseCallbacks(MakeCallback(&BgpSpeaker::HandleClose, this),
+                                MakeCallback(&BgpSpeaker::HandleClose, this));
+
+    std::vector<uint8_t> open;
+    open.push_back(4); // version
+    PutU16(open, m_as > 65535 ? 23456 : m_as); // AS_TRANS for 4-octet ASNs
+    PutU16(open, uint16_t(m_holdTime.GetSeconds()));
+    PutU32(open, s.localAddress.Get()); // BGP identifier
+    open.push_back(0); // no optional parameters
+    Send(s, BGP_OPEN, open);
+    s.state = OPEN_SENT;
+    RestartHoldTimer(s, Seconds(240)); // RFC 4271 large initial hold time
+  }
+
+  // Tears the session down and re-decides every prefix it taught us; the
+  // active side tries again after ConnectRetry.
+  void CloseSession(BgpSession &s, bool retry)
+  {
+    s.keepaliveEvent.Cancel();
+    s.holdEvent.Cancel();
+    s.mraiEvent.Cancel();
+    s.pending.clear();
+    if (s.socket)
+    {
+      s.socket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket>>());
+      s.socket->SetCloseCallbacks(MakeNullCallback<void, Ptr<Socket>>(),
+                                  MakeNullCallback<void, Ptr<Socket>>());
+      s.socket->Close();
+      s.socket = nullptr;
+    }
+    std::vector<uint64_t> dirty;
+    dirty.reserve(s.ribIn.size());
+    s.ribIn.ForEach([&](uint64_t key, const BgpAttrSet &) { dirty.push_back(key); });
+    s.ribIn.Clear();
+    s.ribOut.Clear();
+    s.rxBuffer.clear();
+    s.txBuffer.clear();
+    s.txOffset = 0;
+    s.state = IDLE;
+    if (!m_stopping)
+      for (uint64_t key : dirty)
+        Decide(key);
+
+    if (retry && s.active)
+      s.retryEvent = Simulator::Schedule(m_connectRetry, [this, &s] { Connect(s); });
+  }
+
+  void Send(BgpSession &s, BgpMessageType type, const std::vector<uint8_t> &body)
+  {
+    uint16_t len = kBgpHeaderSize + body.size();
+    s.txBuffer.insert(s.txBuffer.end(), 16, 0xff); // marker
+    PutU16(s.txBuffer, len);
+    s.txBuffer.push_back(type);
+    s.txBuffer.insert(s.txBuffer.end(), body.begin(), body.end());
+
+    m_stats.messagesSent[type]++;
+    m_stats.bytesSent += len;
+    Flush(s);
+  }
+
+  // Pushes queued bytes into the TCP send buffer as far as it has room;
+  // the rest goes out from HandleSend
+  void Flush(BgpSession &s)
+  {
+    while (s.socket && s.txOffset < s.txBuffer.size())
+    {
+      uint32_t n = std::min<std::size_t>(s.socket->GetTxAvailable(), s.txBuffer.size() - s.txOffset);
+      if (n == 0 || s.socket->Send(&s.txBuffer[s.txOffset], n, 0) < 0)
+        break;
+      s.txOffset += n;
+    }
+    if (s.txOffset == s.txBuffer.size())
+    {
+      s.txBuffer.clear();
+      s.txOffset = 0;
+      if (s.txBuffer.capacity() > (1 << 16))
+        s.txBuffer.shrink_to_fit(); // don't hold on to a full-table burst
+    }
+  }
+
+  void HandleSend(Ptr<Socket> socket, uint32_t)
+  {
+    if (BgpSession *s = FindSession(socket))
+      Flush(*s);
+  }
+
+  void HandleRead(Ptr<Socket> socket)
+  {
+    BgpSession *s = FindSession(socket);
+    if (!s)
+      return;
+
+    Ptr<Packet> packet;
+    while ((packet = socket->Recv()) && packet->GetSize() > 0)
+    {
+      std::size_t old = s->rxBuffer.size();
+      s->rxBuffer.resize(old + packet->GetSize());
+      packet->CopyData(&s->rxBuffer[old], packet->GetSize());
+    }
+
+    // Frame messages out of the byte stream
+    std::size_t off = 0;
+    while (s->socket && s->rxBuffer.size() - off >= kBgpHeaderSize)
+    {
+      const uint8_t *h = &s->rxBuffer[off];
+      uint16_t len = (uint16_t(h[16]) << 8) | h[17];
+      if (len < kBgpHeaderSize || len > kBgpMaxMessageSize)
+      {
+        SendNotification(*s, 1, 2); // message header error, bad length
+        return;
+      }
+      if (s->rxBuffer.size() - off < len)
+        break;
+
+      m_stats.messagesReceived++;
+      m_stats.bytesReceived += len;
+      BgpReader body{h + kBgpHeaderSize, h + len};
+      off += len;
+      HandleMessage(*s, h[18], body);
+    }
+    if (s->socket)
+      s->rxBuffer.erase(s->rxBuffer.begin(), s->rxBuffer.begin() + off);
+  }
+
+  /* ---------- Finite state machine ---------- */
+
+  void HandleMessage(BgpSession &s, uint8_t type, BgpReader &body)
+  {
+    if (s.state >= OPEN_CONFIRM)
+      RestartHoldTimer(s, s.holdTime);
+
+    switch (type)
+    {
+    case BGP_OPEN:
+      HandleOpen(s, body);
+      break;
+    case BGP_KEEPALIVE:
+      if (s.state == OPEN_CONFIRM)
+        SessionEstablished(s);
+      break;
+    case BGP_UPDATE:
+      if (s.state == ESTABLISHED)
+      {
+        auto start = std::chrono::steady_clock::now();
+        HandleUpdate(s, body);
+        m_stats.updatesReceived++;
+        m_stats.updateWallNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now() - start).count();
+      }
+      else
+        SendNotification(s, 5, 0); // FSM error
+      break;
+    case BGP_NOTIFICATION:
+      NS_LOG_INFO("[BGP] AS" << m_as << " NOTIFICATION from AS" << s.peerAs);
+      CloseSession(s, true);
+      break;
+    default:
+      SendNotification(s, 1, 3); // bad message type
+    }
+  }
+
+  void HandleOpen(BgpSession &s, BgpReader &body)
+  {
+    uint8_t version = body.U8();
+    uint16_t peerAs = body.U16();
+    uint16_t hold = body.U16();
+    uint32_t peerId = body.U32();
+    if (!body.ok || version != 4 || s.state != OPEN_SENT)
+    {
+      SendNotification(s, 2, 0);
+      return;
+    }
+    if (peerAs != (s.peerAs > 65535 ? 23456 : s.peerAs))
+    {
+      SendNotification(s, 2, 2); // bad peer AS
+      return;
+    }
+
+    s.peerId = peerId;
+    s.holdTime = std::min(m_holdTime, Seconds(hold));
+    Send(s, BGP_KEEPALIVE, {});
+    s.state = OPEN_CONFIRM;
+    RestartHoldTimer(s, s.holdTime);
+  }
+
+  void SessionEstablished(BgpSession &s)
+  {
+    s.state = ESTABLISHED;
+    NS_LOG_INFO("[BGP] AS" << m_as << " session to AS" << s.peerAs << " (" << s.peerAddress
+                << ") established at " << Simulator::Now().GetSeconds() << "s");
+    ScheduleKeepalive(s);
+
+    // Initial table: everything in the Loc-RIB this neighbor may receive
+    int32_t index = &s - &m_sessions[0];
+    std::vector<uint64_t> keys;
+    keys.reserve(m_locRib.size());
+    m_locRib.ForEach([&](uint64_t key, const LocRibEntry &) { keys.push_back(key); });
+    for (uint64_t key : keys)
+      Advertise(s, index, key);
+  }
+
+  void ScheduleKeepalive(BgpSession &s)
+  {
+    if (s.holdTime.IsZero())
+      return;
+    s.keepaliveEvent = Simulator::Schedule(s.holdTime / 3, [this, &s] {
+      Send(s, BGP_KEEPALIVE, {});
+      ScheduleKeepalive(s);
+    });
+  }
+
+  void RestartHoldTimer(BgpSession &s, Time hold)
+  {
+    s.holdEvent.Cancel();
+    if (hold.IsZero())
+      return;
+    s.holdEvent = Simulator::Schedule(hold, [this, &s] {
+      NS_LOG_INFO("[BGP] AS" << m_as << " hold timer expired for AS" << s.peerAs);
+      SendNotification(s, 4, 0);
+    });
+  }
+
+  void SendNotification(BgpSession &s, uint8_t code, uint8_t subcode)
+  {
+    Send(s, BGP_NOTIFICATION, {code, subcode});
+    CloseSession(s, true);
+  }
+
+  /* ---------- Decision process ---------- */
+
+  // RFC 4271 9.1.2.2 order: local origination, highest LOCAL_PREF,
+  // shortest AS_PATH, lowest ORIGIN, lowest MED between routes from the
+  // same neighbor AS, then lowest BGP identifier and peer address.
+  bool Better(const BgpAttributes &a, int32_t fromA, const BgpAttributes &b, int32_t fromB) const
+  {
+    if ((fromA == kLocal) != (fromB == kLocal))
+      return fromA == kLocal;
+    if (a.localPref != b.localPref)
+      return a.localPref > b.localPref;
+    if (a.asPath->size() != b.asPath->size())
+      return a.asPath->size() < b.asPath->size();
+    if (a.origin != b.origin)
+      return a.origin < b.origin;
+    if (!a.asPath->empty() && !b.asPath->empty() && a.asPath->front() == b.asPath->front() &&
+        a.med != b.med)
+      return a.med < b.med;
+    if (fromA == kLocal)
+      return false;
+    const BgpSession &sa = m_sessions[fromA];
+    const BgpSession &sb = m_sessions[fromB];
+    if (sa.peerId != sb.peerId)
+      return sa.peerId < sb.peerId;
+    return sa.peerAddress < sb.peerAddress;
+  }
+
+  // Re-runs the decision process for one prefix; a new best path goes to
+  // the FIB and to every neighbor's Adj-RIB-Out.
+  void Decide(uint64_t key)
+  {
+    m_stats.decisions++;
+
+    const BgpAttrSet *best = m_localRib.Find(key);
+    int32_t bestFrom = kLocal;
+    for (uint32_t i = 0; i < m_sessions.size(); ++i)
+    {
+      const BgpAttrSet *candidate = m_sessions[i].ribIn.Find(key);
+      if (candidate && !IsSuppressed(m_sessions[i], key) && (!best || Better(**candidate, i, **best, bestFrom)))
+      {
+        best = candidate;
+        bestFrom = i;
+      }
+    }
+
+    LocRibEntry *cur = m_locRib.Find(key);
+    bool hadLearned = cur && cur->from != kLocal;
+    if (!best)
+    {
+      if (!cur)
+        return;
+      m_locRib.Erase(key);
+    }
+    else
+    {
+      if (cur && cur->from == bestFrom && cur->attrs == *best)
+        return;
+      m_locRib[key] = {*best, bestFrom};
+    }
+    m_stats.bestPathChanges++;
+    m_stats.lastBestPathChange = Simulator::Now();
+
+    Ipv4Address prefix(uint32_t(key >> 8));
+    Ipv4Mask mask = MaskFromLength(key & 0xff);
+    if (m_installRoutes)
+    {
+      if (best && bestFrom != kLocal)
+        InstallRoute(prefix, mask, (*best)->nextHop);
+      else if (hadLearned)
+        RemoveRoute(prefix, mask);
+    }
+
+    for (uint32_t i = 0; i < m_sessions.size(); ++i)
+      Advertise(m_sessions[i], i, key);
+  }
+
+  // Export policy: not back to the neighbor the route came from nor to one
+  // already on its AS_PATH, and with ValleyFree, routes from peers and
+  // providers only to customers. eBGP prepends our AS, sets NEXT_HOP to our
+  // address on the shared link and only passes on MED we set ourselves.
+  bool Export(const BgpSession &s, int32_t index, const LocRibEntry &e, BgpAttrSet &out) const
+  {
+    const BgpAttributes &in = *e.attrs;
+    if (e.from == index || std::find(in.asPath->begin(), in.asPath->end(), s.peerAs) != in.asPath->end())
+      return false;
+    if (m_valleyFree && e.from != kLocal && s.relationship != BGP_CUSTOMER &&
+        m_sessions[e.from].relationship != BGP_CUSTOMER)
+      return false;
+
+    BgpAttributes a = in;
+    if (in.asPath->empty() || in.asPath->front() != m_as)
+    {
+      std::vector<uint32_t> path(1, m_as);
+      path.insert(path.end(), in.asPath->begin(), in.asPath->end());
+      a.asPath = AsPath(path);
+    }
+    a.nextHop = s.localAddress;
+    a.localPref = 100;
+    if (e.from != kLocal)
+      a.med = 0;
+    out = BgpAttrSet(a);
+    return true;
+  }
+
+  // Schedules a prefix for re-export to a neighbor. With Batching it waits
+  // for the neighbor's next flush: at once if the MRAI timer is idle,
+  // otherwise when it expires, so a prefix that changes several times in
+  // between is sent once, in its final state. Withdrawals wait too, which
+  // lets a withdraw/re-announce flap cancel out.
+  void Advertise(BgpSession &s, int32_t index, uint64_t key)
+  {
+    if (s.state != ESTABLISHED)
+      return;
+    if (!m_batching)
+    {
+      UpdateBatch batch;
+      UpdateAdjRibOut(s, index, key, batch);
+      SendBatch(s, batch);
+      return;
+    }
+    s.pending.push_back(key);
+    if (s.mraiEvent.IsExpired())
+      s.mraiEvent = Simulator::ScheduleNow([this, &s] { FlushPending(s); });
+  }
+
+  // Sends everything pending for a neighbor and, if that was anything,
+  // starts its MRAI timer (jittered to 75-100% as RFC 4271 9.2.1.1 asks)
+  void FlushPending(BgpSession &s)
+  {
+    if (s.state != ESTABLISHED)
+      return;
+    int32_t index = &s - &m_sessions[0];
+    std::sort(s.pending.begin(), s.pending.end());
+    s.pending.erase(std::unique(s.pending.begin(), s.pending.end()), s.pending.end());
+
+    UpdateBatch batch;
+    for (uint64_t key : s.pending)
+      UpdateAdjRibOut(s, index, key, batch);
+    s.pending.clear();
+    if (s.pending.capacity() > (1 << 16))
+      s.pending.shrink_to_fit();
+    if (batch.withdrawn.empty() && batch.announced.empty())
+      return;
+
+    SendBatch(s, batch);
+    s.mraiEvent = Simulator::Schedule(m_mrai * m_jitter->GetValue(0.75, 1.0), [this, &s] { FlushPending(s); });
+  }
+
+  // Changes to one neighbor's Adj-RIB-Out, announcements grouped by
+  // attribute set
+  struct UpdateBatch
+  {
+    std::vector<uint64_t> withdrawn;
+    std::vector<std::pair<BgpAttrSet, std::vector<uint64_t>>> announced;
+    std::unordered_map<std::size_t, std::size_t> group; // attribute set id -> index in announced
+  };
+
+  // Brings one prefix of a neighbor's Adj-RIB-Out in line with the Loc-RIB
+  // and records what has to be sent for it
+  void UpdateAdjRibOut(BgpSession &s, int32_t index, uint64_t key, UpdateBatch &batch)
+  {
+    BgpAttrSet out;
+    const LocRibEntry *loc = m_locRib.Find(key);
+    bool exported = loc && Export(s, index, *loc, out);
+    BgpAttrSet *sent = s.ribOut.Find(key);
+    if (!exported)
+    {
+      if (!sent)
+        return;
+      batch.withdrawn.push_back(key);
+      s.ribOut.Erase(key);
+      return;
+    }
+    if (sent && *sent == out)
+      return;
+    auto group = batch.group.emplace(out.GetId(), batch.announced.size());
+    if (group.second)
+      batch.announced.emplace_back(out, std::vector<uint64_t>());
+    batch.announced[group.first->second].second.push_back(key);
+    s.ribOut[key] = out;
+  }
+
+  // Walks the path from the origin towards us: once it has crossed a peer
+  // link or gone down to a customer it may only keep going down. Hops
+  // between ASes of unknown relationship are not held against it.
+  bool IsValleyFree(const BgpSession &s, const std::vector<uint32_t> &path) const
+  {
+    bool descending = false;
+    auto hop = [&descending](BgpRelationship receiverToSender) {
+      // receiverToSender: what the sending AS is to the receiving one
+      if (receiverToSender == BGP_UNKNOWN)
+        return true;
+      if (descending && receiverToSender != BGP_PROVIDER)
+        return false;
+      descending = descending || receiverToSender != BGP_CUSTOMER;
+      return true;
+    };
+    if (m_relationships)
+      for (std::size_t i = path.size(); i-- > 1;)
+        if (path[i] != path[i - 1] && !hop(m_relationships->Get(path[i - 1], path[i])))
+          return false;
+    return hop(s.relationship);
+  }
+
+  /* ---------- UPDATE ---------- */
 
-/* ================= BGP DATA ================= */
+  // With Batching, withdrawals and the prefixes of each attribute set are
+  // packed into as few UPDATEs as the 4096-byte limit allows; without it
+  // every prefix gets its own UPDATE.
+  void SendBatch(BgpSession &s, const UpdateBatch &batch)
+  {
+    std::size_t perUpdate = m_batching ? SIZE_MAX : 1;
+    const std::size_t room = kBgpMaxMessageSize - kBgpHeaderSize - 4; // minus the two length fields
 
-struct BgpRoute
-{
-  Ipv4Address prefix;
-  Ipv4Mask mask;
-  std::vector<uint32_t> asPath;
+    std::vector<uint8_t> withdrawn;
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < batch.withdrawn.size(); ++i)
+    {
+      PutPrefix(withdrawn, Ipv4Address(uint32_t(batch.withdrawn[i] >> 8)), MaskFromLength(batch.withdrawn[i] & 0xff));
+      m_stats.prefixesSent++;
+      n++;
+      if (i + 1 == batch.withdrawn.size() || n == perUpdate ||
+          withdrawn.size() + PrefixSize(batch.withdrawn[i + 1]) > room)
+      {
+        SendUpdate(s, withdrawn, {}, {});
+        withdrawn.clear();
+        n = 0;
+      }
+    }
+
+    for (const auto &group : batch.announced)
+    {
+      std::vector<uint8_t> attrs = EncodeAttributes(*group.first);
+      const std::vector<uint64_t> &keys = group.second;
+      std::vector<uint8_t> nlri;
+      for (std::size_t i = 0; i < keys.size(); ++i)
+      {
+        PutPrefix(nlri, Ipv4Address(uint32_t(keys[i] >> 8)), MaskFromLength(keys[i] & 0xff));
+        m_stats.prefixesSent++;
+        n++;
+        if (i + 1 == keys.size() || n == perUpdate || attrs.size() + nlri.size() + PrefixSize(keys[i + 1]) > room)
+        {
+          SendUpdate(s, {}, attrs, nlri);
+          nlri.clear();
+          n = 0;
+        }
+      }
+    }
+  }
+
+  static std::size_t PrefixSize(uint64_t key)
+  {
+    return 1 + ((key & 0xff) + 7) / 8;
+  }
+
+  void SendUpdate(BgpSession &s, const std::vector<uint8_t> &withdrawn, const std::vector<uint8_t> &attrs,
+                  const std::vector<uint8_t> &nlri)
+  {
+    std::vector<uint8_t> body;
+    PutU16(body, withdrawn.size());
+    body.insert(body.end(), withdrawn.begin(), withdrawn.end());
+    PutU16(body, attrs.size());
+    body.insert(body.end(), attrs.begin(), attrs.end());
+    body.insert(body.end(), nlri.begin(), nlri.end());
+    Send(s, BGP_UPDATE, body);
+  }
+
+  // Appends one path attribute, with the extended-length flag (0x10) and
+  // a two-octet length when the value does not fit in 255 octets
+  static void PutAttribute(std::vector<uint8_t> &attrs, uint8_t flags, uint8_t type,
+                           const std::vector<uint8_t> &value)
+  {
+    if (value.size() > 255)
+    {
+      attrs.insert(attrs.end(), {uint8_t(flags | 0x10), type});
+      PutU16(attrs, value.size());
+    }
+    else
+    {
+      attrs.insert(attrs.end(), {flags, type, uint8_t(value.size())});
+    }
+    attrs.insert(attrs.end(), value.begin(), value.end());
+  }
+
+  // ORIGIN, AS_PATH, NEXT_HOP and, when set, MED and COMMUNITIES
+  static std::vector<uint8_t> EncodeAttributes(const BgpAttributes &a)
+  {
+    std::vector<uint8_t> attrs;
+    attrs.insert(attrs.end(), {0x40, 1, 1, a.origin});
+
+    // AS_SEQUENCE segments of at most 255 ASNs each
+    std::vector<uint8_t> value;
+    const std::vector<uint32_t> &path = *a.asPath;
+    for (std::size_t i = 0; i < path.size(); i += 255)
+    {
+      std::size_t count = std::min<std::size_t>(255, path.size() - i);
+      value.insert(value.end(), {2, uint8_t(count)});
+      for (std::size_t k = i; k < i + count; ++k)
+        PutU32(value, path[k]);
+    }
+    PutAttribute(attrs, 0x40, 2, value);
+
+    attrs.insert(attrs.end(), {0x40, 3, 4});
+    PutU32(attrs, a.nextHop.Get());
+
+    if (a.med != 0)
+    {
+      attrs.insert(attrs.end(), {0x80, 4, 4});
+      PutU32(attrs, a.med);
+    }
+
+    if (!a.communities.empty())
+    {
+      value.clear();
+      for (uint32_t c : a.communities)
+        PutU32(value, c);
+      PutAttribute(attrs, 0xc0, 8, value);
+    }
+    return attrs;
+  }
+
+  void HandleUpdate(BgpSession &s, BgpReader &body)
+  {
+    std::vector<uint64_t> dirty;
+    int32_t index = &s - &m_sessions[0];
+
+    uint16_t withdrawnLen = body.U16();
+    BgpReader withdrawn{body.p, body.p + std::min<std::ptrdiff_t>(withdrawnLen, body.end - body.p)};
+    body.p = withdrawn.end;
+    while (withdrawn.ok && withdrawn.p < withdrawn.end)
+    {
+      Ipv4Address prefix;
+      Ipv4Mask mask;
+      withdrawn.Prefix(prefix, mask);
+      if (withdrawn.ok && s.ribIn.Erase(PrefixKey(prefix, mask)))
+      {
+        dirty.push_back(PrefixKey(prefix, mask));
+        if (m_damping)
+          Penalize(s, index, PrefixKey(prefix, mask), kWithdrawalPenalty);
+      }
+    }
+
+    BgpAttributes a;
+    a.localPref = s.localPref;
+    std::vector<uint32_t> path;
+    bool hasNextHop = false;
+    uint16_t attrLen = body.U16();
+    BgpReader attrs{body.p, body.p + std::min<std::ptrdiff_t>(attrLen, body.end - body.p)};
+    body.p = attrs.end;
+    while (attrs.ok && attrs.p < attrs.end)
+    {
+      uint8_t flags = attrs.U8();
+      uint8_t type = attrs.U8();
+      uint16_t len = (flags & 0x10) ? attrs.U16() : attrs.U8();
+      if (!attrs.Need(len))
+        break;
+      BgpReader value{attrs.p, attrs.p + len};
+      attrs.p += len;
+      if (type == 1) // ORIGIN
+      {
+        a.origin = value.U8();
+      }
+      else if (type == 2) // AS_PATH
+      {
+        while (value.ok && value.p < value.end)
+        {
+          value.U8(); // segment type
+          uint8_t count = value.U8();
+          for (uint8_t i = 0; i < count && value.ok; ++i)
+            path.push_back(value.U32());
+        }
+      }
+      else if (type == 3) // NEXT_HOP
+      {
+        a.nextHop = Ipv4Address(value.U32());
+        hasNextHop = true;
+      }
+      else if (type == 4) // MULTI_EXIT_DISC
+      {
+        a.med = value.U32();
+      }
+      else if (type == 8) // COMMUNITIES
+      {
+        while (value.ok && value.p < value.end)
+          a.communities.push_back(value.U32());
+      }
+    }
+    if (!withdrawn.ok || !attrs.ok || !body.ok)
+    {
+      SendNotification(s, 3, 1); // malformed attribute list
+      return;
+    }
+    // Routes need a NEXT_HOP on a link shared with us (eBGP, RFC 4271 5.1.3)
+    if (body.p < body.end && !hasNextHop)
+    {
+      SendNotification(s, 3, 3); // missing well-known attribute
+      return;
+    }
+    if (body.p < body.end && InterfaceFor(a.nextHop, nullptr) < 0)
+    {
+      SendNotification(s, 3, 8); // invalid NEXT_HOP
+      return;
+    }
+
+    // A looped path is treated as a withdrawal of the prefix, and so is a
+    // leaked one with RejectLeaks
+    bool loop = std::find(path.begin(), path.end(), m_as) != path.end();
+    bool leak = !loop && body.p < body.end && !IsValleyFree(s, path);
+    if (leak)
+    {
+      m_stats.leakUpdates++;
+      m_stats.firstLeak = std::min(m_stats.firstLeak, Simulator::Now());
+      std::ostringstream asPath;
+      for (uint32_t asn : path)
+        asPath << " " << asn;
+      NS_LOG_INFO("[SECURITY] AS" << m_as << " route leak from AS" << s.peerAs << ", AS_PATH" << asPath.str()
+                  << (m_rejectLeaks ? " (rejected)" : ""));
+    }
+    loop = loop || (leak && m_rejectLeaks);
+    BgpAttrSet attrSet;
+    if (!loop && body.p < body.end)
+    {
+      a.asPath = AsPath(path);
+      attrSet = BgpAttrSet(a);
+    }
+    std::vector<std::pair<Ipv4Address, Ipv4Mask>> nlri;
+    while (body.ok && body.p < body.end)
+    {
+      Ipv4Address prefix;
+      Ipv4Mask mask;
+      body.Prefix(prefix, mask);
+      if (body.ok)
+        nlri.emplace_back(prefix, mask);
+    }
+
+    // Validated as one batch, so the clock is read twice per UPDATE rather
+    // than twice per route
+    std::vector<RpkiState> rpki;
+    if (m_roas && !loop && !nlri.empty())
+    {
+      uint32_t origin = path.empty() ? 0 : path.back();
+      rpki.reserve(nlri.size());
+      auto start = std::chrono::steady_clock::now();
+      for (const auto &n : nlri)
+        rpki.push_back(m_roas->Validate(n.first, n.second.GetPrefixLength(), origin));
+      m_stats.rpkiWallNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - start).count();
+    }
+
+    for (std::size_t k = 0; k < nlri.size(); ++k)
+    {
+      m_stats.prefixesReceived++;
+      m_stats.leakedPrefixes += leak;
+      uint64_t key = PrefixKey(nlri[k].first, nlri[k].second);
+      bool invalid = false;
+      if (!rpki.empty())
+      {
+        m_stats.rpki[rpki[k]]++;
+        invalid = rpki[k] == RPKI_INVALID && m_rejectInvalid;
+      }
+      if (loop || invalid)
+      {
+        if (s.ribIn.Erase(key))
+          dirty.push_back(key);
+        continue;
+      }
+      if (m_damping)
+      {
+        const BgpAttrSet *old = s.ribIn.Find(key);
+        if (old && !(*old == attrSet))
+          Penalize(s, index, key, kAttributeChangePenalty);
+      }
+      s.ribIn[key] = attrSet;
+      dirty.push_back(key);
+    }
+
+    for (uint64_t key : dirty)
+      Decide(key);
+  }
+
+  /* ---------- Route flap damping ---------- */
+
+  static constexpr double kWithdrawalPenalty = 1000;
+  static constexpr double kAttributeChangePenalty = 500;
+
+  bool IsSuppressed(const BgpSession &s, uint64_t key) const
+  {
+    if (!m_damping)
+      return false;
+    const DampingState *d = s.damping.Find(key);
+    return d && d->suppressed;
+  }
+
+  double DecayedPenalty(const DampingState &d) const
+  {
+    return d.penalty * std::exp2(-(Simulator::Now() - d.updated).GetSeconds() / m_halfLife.GetSeconds());
+  }
+
+  // Adds a flap to a prefix's history and suppresses the route once the
+  // penalty crosses DampingSuppress. The penalty is capped so that it
+  // decays to DampingReuse within DampingMaxSuppress.
+  void Penalize(BgpSession &s, int32_t index, uint64_t key, double penalty)
+  {
+    double ceiling = m_reuseLimit * std::exp2(m_maxSuppress.GetSeconds() / m_halfLife.GetSeconds());
+    DampingState &d = s.damping[key];
+    d.penalty = std::min(DecayedPenalty(d) + penalty, ceiling);
+    d.updated = Simulator::Now();
+    if (!d.suppressed && d.penalty > m_suppressLimit)
+    {
+      d.suppressed = true;
+      m_stats.suppressions++;
+      NS_LOG_INFO("[BGP] AS" << m_as << " suppresses " << Ipv4Address(uint32_t(key >> 8)) << "/" << (key & 0xff)
+                  << " from AS" << s.peerAs << " (penalty " << d.penalty << ")");
+    }
+    ScheduleReuse(index, key, d);
+  }
+
+  // When a suppressed route's penalty will have decayed to DampingReuse,
+  // or an unsuppressed one's to half of it and its history can go,
+  // rounded up to the second like RFC 2439's reuse lists
+  Time ReuseTime(const DampingState &d) const
+  {
+    double limit = d.suppressed ? m_reuseLimit : m_reuseLimit / 2;
+    double halfLives = std::max(0.0, std::log2(d.penalty / limit));
+    return d.updated + Seconds(std::ceil(m_halfLife.GetSeconds() * halfLives));
+  }
+
+  // Queues a prefix for its reuse time unless it is queued for an earlier
+  // one already (it is then looked at again then); one timer serves the
+  // whole queue
+  void ScheduleReuse(int32_t index, uint64_t key, DampingState &d)
+  {
+    Time at = ReuseTime(d);
+    if (d.due <= at)
+      return;
+    d.due = at;
+    m_reuseQueue.push({at, index, key});
+    if (m_reuseEvent.IsExpired() || at < m_reuseAt)
+    {
+      m_reuseEvent.Cancel();
+      m_reuseAt = at;
+      m_reuseEvent = Simulator::Schedule(at - Simulator::Now(), [this] { ReuseDue(); });
+    }
+  }
+
+  // Releases the suppressed routes whose time has come and forgets the
+  // histories that have decayed below half of DampingReuse. A prefix that
+  // flapped again in the meantime has a higher penalty by now and goes
+  // back into the queue.
+  void ReuseDue()
+  {
+    while (!m_reuseQueue.empty() && m_reuseQueue.top().at <= Simulator::Now())
+    {
+      ReuseEntry e = m_reuseQueue.top();
+      m_reuseQueue.pop();
+      PrefixMap<DampingState> &damping = m_sessions[e.session].damping;
+      DampingState *d = damping.Find(e.key);
+      if (!d || d->due != e.at)
+        continue; // superseded by an earlier entry
+      d->due = Time::Max();
+      d->penalty = DecayedPenalty(*d);
+      d->updated = Simulator::Now();
+      if (d->suppressed && d->penalty <= m_reuseLimit)
+      {
+        d->suppressed = false;
+        m_stats.reuses++;
+        Decide(e.key);
+        d = damping.Find(e.key);
+      }
+      if (!d->suppressed && d->penalty <= m_reuseLimit / 2)
+      {
+        damping.Erase(e.key);
+        continue;
+      }
+      d->due = ReuseTime(*d);
+      m_reuseQueue.push({d->due, e.session, e.key});
+    }
+    if (!m_reuseQueue.empty())
+    {
+      m_reuseAt = m_reuseQueue.top().at;
+      m_reuseEvent = Simulator::Schedule(m_reuseAt - Simulator::Now(), [this] { ReuseDue(); });
+    }
+  }
+
+  struct ReuseEntry
+  {
+    Time at;
+    int32_t session;
+    uint64_t key;
+
+    bool operator>(const ReuseEntry &o) const
+    {
+      return at > o.at;
+    }
+  };
+
+  uint32_t m_as{0};
+  Time m_holdTime;
+  Time m_connectRetry;
+  bool m_installRoutes = true;
+  Time m_mrai;
+  bool m_batching = true;
+  Ptr<UniformRandomVariable> m_jitter = CreateObject<UniformRandomVariable>();
+  bool m_valleyFree = true;
+  bool m_rejectLeaks = false;
+  bool m_rejectInvalid = false;
+  bool m_damping = false;
+  Time m_halfLife;
+  double m_suppressLimit = 2000;
+  double m_reuseLimit = 750;
+  Time m_maxSuppress;
+  std::priority_queue<ReuseEntry, std::vector<ReuseEntry>, std::greater<ReuseEntry>> m_reuseQueue;
+  EventId m_reuseEvent;
+  Time m_reuseAt;
+  const AsRelationships *m_relationships = nullptr;
+  const RoaTable *m_roas = nullptr;
+  Ptr<BgpFibRouting> m_fib;
+  Ptr<Socket> m_listener;
+  bool m_stopping = false;
+  std::vector<BgpSession> m_sessions;
+  PrefixMap<BgpAttrSet> m_localRib; // originated here
+  PrefixMap<LocRibEntry> m_locRib;  // best route per prefix
+  BgpStats m_stats;
 };
 
-class BgpSpeaker : public Object
+NS_OBJECT_ENSURE_REGISTERED(BgpFibRouting);
+NS_OBJECT_ENSURE_REGISTERED(BgpSpeaker);
+
+/* ================= FULL-TABLE INPUT ================= */
+
+// Synthetic DFZ-like table: prefix lengths follow the shape of the real
+// IPv4 table (mostly /24, then /22, /23, /20, /16 ...) and every prefix
+// belongs to one of ~70k origin ASes whose path (via one of a handful of
+// tier-1 upstreams) is fixed, so routes share paths the way they do in a
+// real feed. Our own 10/8 and 192.168/16 are never generated.
+static std::vector<BgpRoute> GenerateFullTable(uint32_t n, uint32_t seed)
 {
-public:
-  static TypeId GetTypeId()
+  static const struct
   {
-    static TypeId tid = TypeId("BgpSpeaker")
-      .SetParent<Object>()
-      .AddConstructor<BgpSpeaker>();
-    return tid;
+    uint8_t len;
+    uint32_t weight; // per mille
+  } kLengths[] = {{24, 580}, {23, 90}, {22, 120}, {21, 40}, {20, 50}, {19, 30},
+                  {18, 20},  {17, 15}, {16, 35},  {15, 5},  {14, 5},  {13, 5},  {12, 5}};
+  static const uint32_t kUpstreams[] = {3356, 1299, 174, 2914, 6939, 6762, 3257};
+  const uint32_t kOrigins = 70000;
+
+  // Distinct prefixes the generator can produce: per length, the /8s 1-223
+  // minus 10 and 127, minus 192.168/16 for lengths of 16 and more
+  uint64_t space = 0;
+  for (const auto &l : kLengths)
+    space += (221ull << (l.len - 8)) - (l.len >= 16 ? 1ull << (l.len - 16) : 0);
+  NS_ABORT_MSG_IF(n > space, "Cannot generate " << n << " distinct prefixes, at most " << space);
+
+  std::mt19937 rng(seed);
+  std::discrete_distribution<uint32_t> lengthDist;
+  {
+    std::vector<uint32_t> w;
+    for (const auto &l : kLengths)
+      w.push_back(l.weight);
+    lengthDist = std::discrete_distribution<uint32_t>(w.begin(), w.end());
+  }
+
+  std::vector<BgpRoute> table;
+  table.reserve(n);
+  std::unordered_set<uint64_t> seen;
+  seen.reserve(n);
+  while (table.size() < n)
+  {
+    uint8_t len = kLengths[lengthDist(rng)].len;
+    uint32_t a = (1u << 24) + rng() % (223u << 24); // 1.0.0.0 - 223.255.255.255
+    if ((a >> 24) == 10 || (a >> 24) == 127 || (a >> 16) == 0xc0a8)
+      continue;
+    Ipv4Mask mask = MaskFromLength(len);
+    Ipv4Address prefix(a & mask.Get());
+    if (!seen.insert(PrefixKey(prefix, mask)).second)
+      continue;
+
+    uint32_t origin = 1000 + Mix32(a >> 12) % kOrigins;
+    uint32_t h = Mix32(origin);
+    std::vector<uint32_t> path(1, kUpstreams[h % 7]);
+    for (uint32_t i = 0; i < (h >> 8) % 4; ++i)
+      path.push_back(1000 + Mix32(h + i) % 20000); // transit
+    path.push_back(origin);
+    table.emplace_back(prefix, mask, path);
+  }
+  return table;
+}
+
+// ROAs for a synthetic table at roughly today's RPKI coverage: every other
+// prefix gets one for its origin at exact length, and one in fifty of
+// those names another AS (a stale ROA or a hijack, so INVALID)
+static void AddSyntheticRoas(RoaTable &roas, const std::vector<BgpRoute> &table, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  for (const auto &r : table)
+  {
+    if (rng() % 2 || r.attrs->asPath->empty())
+      continue;
+    uint32_t origin = r.attrs->asPath->back() + (rng() % 50 == 0);
+    roas.Add(r.prefix, r.mask.GetPrefixLength(), r.mask.GetPrefixLength(), origin);
   }
+}
 
-  BgpSpeaker() = default;
-  explicit BgpSpeaker(uint32_t asn) : m_as(asn) {}
+// Text dump, one route per line: "a.b.c.d/len [as-path ...]" ('#' starts a
+// comment). An MRT RIB converts with: bgpdump -m rib.mrt | cut -d'|' -f6,7 | tr '|' ' '
+static std::vector<BgpRoute> LoadPrefixFile(const std::string &path)
+{
+  std::ifstream in(path);
+  if (!in)
+    NS_FATAL_ERROR("Cannot open prefix file " << path);
 
-  void Initialize(Ptr<Node> n, Ipv4Address nextHop)
+  std::vector<BgpRoute> table;
+  std::unordered_set<uint64_t> seen;
+  std::string line;
+  while (std::getline(in, line))
   {
-    m_node = n;
-    m_ipv4 = n->GetObject<Ipv4>();
-    m_nextHop = nextHop;
+    std::istringstream fields(line.substr(0, line.find('#')));
+    std::string prefix;
+    if (!(fields >> prefix))
+      continue;
+    std::size_t slash = prefix.find('/');
+    if (slash == std::string::npos || prefix.find(':') != std::string::npos)
+      continue; // not an IPv4 prefix
+
+    Ipv4Mask mask = MaskFromLength(std::min(32, std::atoi(prefix.c_str() + slash + 1)));
+    Ipv4Address addr = Ipv4Address(prefix.substr(0, slash).c_str()).CombineMask(mask);
+    std::vector<uint32_t> asPath;
+    uint32_t asn;
+    while (fields >> asn)
+      if (asPath.empty() || asPath.back() != asn) // drop prepending
+        asPath.push_back(asn);
+    if (seen.insert(PrefixKey(addr, mask)).second)
+      table.emplace_back(addr, mask, asPath);
   }
+  return table;
+}
+
+// Heap in use (glibc), else the resident set size from /proc (Linux).
+// ex4.cc has a copy; keep the two in step.
+static double MemoryInUseMiB()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  struct mallinfo2 mi = mallinfo2();
+  return (mi.uordblks + mi.hblkhd) / double(1 << 20);
+#else
+  std::ifstream statm("/proc/self/statm");
+  uint64_t pages = 0;
+  uint64_t resident = 0;
+  statm >> pages >> resident;
+  return resident * double(sysconf(_SC_PAGESIZE)) / (1 << 20);
+#endif
+}
+
+// RIB memory for n prefixes learned from one neighbor and passed on to
+// another (Adj-RIB-In, Loc-RIB, Adj-RIB-Out), stored the old way (a route
+// struct with its own AS_PATH vector per entry, in unordered_maps) and the
+// current way (interned attribute handles in PrefixMaps)
+static void BenchmarkRibMemory(uint32_t n)
+{
+  const uint32_t myAs = 65001;
+  const Ipv4Address peer("192.168.1.2");
+  const Ipv4Address self("192.168.2.1");
 
-  void AddNeighbor(uint32_t asn)
+  // Input as plain vectors, so neither layout inherits interned paths
+  std::vector<std::pair<uint64_t, std::vector<uint32_t>>> input;
   {
-    m_neighbors.push_back(asn);
+    std::vector<BgpRoute> table = GenerateFullTable(n, 1);
+    input.reserve(table.size());
+    for (const auto &r : table)
+      input.emplace_back(PrefixKey(r.prefix, r.mask), *r.attrs->asPath);
   }
 
-  void Advertise(const BgpRoute &r)
+  struct PerRouteRoute // BgpRoute before interning
   {
-    NS_LOG_UNCOND("[BGP] AS" << m_as << " advertises "
-                  << r.prefix << "/" << r.mask.GetPrefixLength());
+    Ipv4Address prefix;
+    Ipv4Mask mask;
+    std::vector<uint32_t> asPath;
+    Ipv4Address nextHop;
+    uint8_t origin;
+    uint32_t localPref;
+    uint32_t med;
+  };
+  struct PerRouteLocEntry
+  {
+    PerRouteRoute route;
+    int32_t from;
+  };
+  struct InternedLocEntry
+  {
+    BgpAttrSet attrs;
+    int32_t from = 0;
+  };
 
-    for (auto n : m_neighbors)
-      NS_LOG_UNCOND("  -> sent to AS" << n);
+  std::cout << "\n=== RIB MEMORY BENCHMARK (" << input.size()
+            << " prefixes in Adj-RIB-In, Loc-RIB and Adj-RIB-Out) ===" << std::endl;
+
+  double base = MemoryInUseMiB();
+  auto start = std::chrono::steady_clock::now();
+  double perRouteMiB;
+  double perRouteSecs;
+  {
+    std::unordered_map<uint64_t, PerRouteRoute> ribIn;
+    std::unordered_map<uint64_t, PerRouteLocEntry> locRib;
+    std::unordered_map<uint64_t, PerRouteRoute> ribOut;
+    for (const auto &e : input)
+    {
+      Ipv4Mask mask = MaskFromLength(e.first & 0xff);
+      PerRouteRoute in{Ipv4Address(uint32_t(e.first >> 8)), mask, e.second, peer, 0, 100, 0};
+      PerRouteRoute out = in;
+      out.asPath.insert(out.asPath.begin(), myAs);
+      out.nextHop = self;
+      ribIn[e.first] = in;
+      locRib[e.first] = {in, 0};
+      ribOut[e.first] = out;
+    }
+    perRouteMiB = MemoryInUseMiB() - base;
+    perRouteSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
   }
 
-  void InstallRoute(Ipv4Address net, Ipv4Mask mask)
+  base = MemoryInUseMiB();
+  start = std::chrono::steady_clock::now();
+  double internedMiB;
+  double internedSecs;
+  std::size_t paths;
+  std::size_t attrSets;
   {
-    Ipv4StaticRoutingHelper helper;
-    Ptr<Ipv4StaticRouting> rt = helper.GetStaticRouting(m_ipv4);
-    rt->AddNetworkRouteTo(net, mask, m_nextHop, 1);
+    PrefixMap<BgpAttrSet> ribIn;
+    PrefixMap<InternedLocEntry> locRib;
+    PrefixMap<BgpAttrSet> ribOut;
+    std::vector<uint32_t> outPath;
+    for (const auto &e : input)
+    {
+      BgpAttributes a;
+      a.asPath = AsPath(e.second);
+      a.nextHop = peer;
+      BgpAttrSet in(a);
+      outPath.assign(1, myAs);
+      outPath.insert(outPath.end(), e.second.begin(), e.second.end());
+      a.asPath = AsPath(outPath);
+      a.nextHop = self;
+      ribIn[e.first] = in;
+      locRib[e.first] = {in, 0};
+      ribOut[e.first] = BgpAttrSet(a);
+    }
+    internedMiB = MemoryInUseMiB() - base;
+    internedSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    paths = AsPath::GetNInterned();
+    attrSets = BgpAttrSet::GetNInterned();
   }
 
-private:
-  uint32_t m_as{0};
-  Ptr<Node> m_node;
-  Ptr<Ipv4> m_ipv4;
-  Ipv4Address m_nextHop;
-  std::vector<uint32_t> m_neighbors;
+  double perPrefix = double(1 << 20) / input.size();
+  std::cout << "Per-route vectors, unordered_map: " << perRouteMiB << " MiB, " << perRouteMiB * perPrefix
+            << " B/prefix, built in " << perRouteSecs << " s" << std::endl;
+  std::cout << "Interned handles, PrefixMap:      " << internedMiB << " MiB, " << internedMiB * perPrefix
+            << " B/prefix, built in " << internedSecs << " s (" << paths << " AS paths, " << attrSets
+            << " attribute sets)" << std::endl;
+  std::cout << "Reduction: " << perRouteMiB / internedMiB << "x" << std::endl;
+}
+
+// Per-packet RouteOutput cost of BgpFibRouting and of Ipv4StaticRouting
+// holding the same synthetic table, at 1k, 100k and 1M routes. Static
+// routing scans its list for a duplicate on every insert, so loading it is
+// quadratic; it is only measured up to staticMax routes.
+static void BenchmarkFib(uint32_t staticMax)
+{
+  NodeContainer pair;
+  pair.Create(2);
+  InternetStackHelper internet;
+  internet.Install(pair);
+  PointToPointHelper link;
+  NetDeviceContainer devices = link.Install(pair);
+  Ipv4AddressHelper address("192.168.0.0", "255.255.255.252");
+  Ipv4InterfaceContainer ifs = address.Assign(devices);
+  Ptr<Ipv4> ipv4 = pair.Get(0)->GetObject<Ipv4>();
+  Ipv4Address gateway = ifs.GetAddress(1);
+  uint32_t interface = ipv4->GetInterfaceForDevice(devices.Get(0));
+  Ptr<Packet> packet = Create<Packet>();
+
+  auto timeLookups = [&](Ptr<Ipv4RoutingProtocol> rp, const std::vector<Ipv4Header> &headers, std::size_t count) {
+    Socket::SocketErrno err;
+    std::size_t routed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < count; ++i)
+      if (rp->RouteOutput(packet, headers[i % headers.size()], nullptr, err))
+        routed++;
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    NS_ABORT_MSG_IF(routed != count, "FIB benchmark destination without a route");
+    return ns / count;
+  };
+
+  std::cout << "\n=== FIB LOOKUP BENCHMARK (RouteOutput per packet) ===" << std::endl;
+  for (uint32_t n : {1000u, 100000u, 1000000u})
+  {
+    std::vector<BgpRoute> table = GenerateFullTable(n, 2);
+
+    // Destinations are random hosts inside random table prefixes
+    std::mt19937 rng(n);
+    std::vector<Ipv4Header> headers(1 << 16);
+    for (auto &h : headers)
+    {
+      const BgpRoute &r = table[rng() % n];
+      h.SetDestination(Ipv4Address(r.prefix.Get() | (rng() & ~r.mask.Get())));
+    }
+
+    Ptr<BgpFibRouting> fib = CreateObject<BgpFibRouting>();
+    fib->SetIpv4(ipv4);
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &r : table)
+      fib->AddRoute(r.prefix, r.mask, gateway, interface);
+    double fibBuild = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double fibNs = timeLookups(fib, headers, 1 << 22);
+
+    std::cout << n << " routes: trie " << fibNs << " ns/packet (" << fib->GetNNodes() << " nodes, "
+              << fib->GetMemoryBytes() / double(1 << 20) << " MiB, loaded in " << fibBuild << " s)";
+    if (n > staticMax)
+    {
+      std::cout << "; static list not loaded (raise --fibStaticMax)" << std::endl;
+      continue;
+    }
+
+    Ptr<Ipv4StaticRouting> list = CreateObject<Ipv4StaticRouting>();
+    list->SetIpv4(ipv4);
+    start = std::chrono::steady_clock::now();
+    for (const auto &r : table)
+      list->AddNetworkRouteTo(r.prefix, r.mask, gateway, interface);
+    double listBuild = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double listNs = timeLookups(list, headers, std::max<std::size_t>(1000, 100000000 / n));
+
+    std::cout << "; static list " << listNs << " ns/packet (loaded in " << listBuild << " s), "
+              << listNs / fibNs << "x slower" << std::endl;
+  }
+  Simulator::Destroy();
+}
+
+// Full mesh of nAs ASes (64512, 64513 ...) on 1 Gbps links. Every AS
+// re-exports to every other, so a withdrawal sets off path exploration;
+// routes are not installed.
+static std::vector<Ptr<BgpSpeaker>> BuildClique(uint32_t nAs)
+{
+  NodeContainer nodes;
+  nodes.Create(nAs);
+  InternetStackHelper internet;
+  internet.Install(nodes);
+  PointToPointHelper link;
+  link.SetDeviceAttribute("DataRate", StringValue("1Gbps"));
+  link.SetChannelAttribute("Delay", StringValue("1ms"));
+  Ipv4AddressHelper address("172.16.0.0", "255.255.255.252");
+
+  std::vector<Ptr<BgpSpeaker>> speakers;
+  for (uint32_t i = 0; i < nAs; ++i)
+  {
+    Ptr<BgpSpeaker> s = CreateObjectWithAttributes<BgpSpeaker>("Asn", UintegerValue(64512 + i));
+    s->SetAttribute("ValleyFree", BooleanValue(false)); // peers re-export to peers
+    s->SetAttribute("InstallRoutes", BooleanValue(false));
+    s->SetStartTime(Seconds(1));
+    nodes.Get(i)->AddApplication(s);
+    speakers.push_back(s);
+  }
+  for (uint32_t i = 0; i < nAs; ++i)
+    for (uint32_t j = i + 1; j < nAs; ++j)
+    {
+      Ipv4InterfaceContainer ifs = address.Assign(link.Install(nodes.Get(i), nodes.Get(j)));
+      address.NewNetwork();
+      speakers[i]->AddNeighbor(64512 + j, ifs.GetAddress(1));
+      speakers[j]->AddNeighbor(64512 + i, ifs.GetAddress(0));
+    }
+  return speakers;
+}
+
+// Churn in a full mesh of nAs ASes, the clique of Labovitz et al.: the
+// first AS announces `prefixes` prefixes, then withdraws and re-announces
+// them `flaps` times. After each withdrawal the rest try every longer
+// path before giving up. Runs once with one UPDATE per prefix and change,
+// once with batching and the given MRAI, and reports UPDATEs and prefixes
+// sent and the mean time from an event to the last best-path change it
+// causes.
+static void BenchmarkChurn(uint32_t nAs, uint32_t prefixes, uint32_t flaps, Time mrai)
+{
+  std::vector<BgpRoute> table;
+  for (const auto &r : GenerateFullTable(prefixes, 3))
+    table.emplace_back(r.prefix, r.mask, std::vector<uint32_t>());
+  const Time gap = Seconds(10) + mrai * (nAs + 1); // enough to settle
+
+  std::cout << "\n=== CHURN BENCHMARK (" << nAs << "-AS clique, " << prefixes << " prefixes, " << flaps
+            << " withdraw/announce flaps) ===" << std::endl;
+  for (bool batching : {false, true})
+  {
+    std::vector<Ptr<BgpSpeaker>> speakers = BuildClique(nAs);
+    for (const auto &s : speakers)
+    {
+      s->SetAttribute("Mrai", TimeValue(mrai));
+      s->SetAttribute("Batching", BooleanValue(batching));
+    }
+
+    // Announce at 5s, then alternate withdrawals and announcements; each
+    // event's convergence is read just before the next one
+    std::vector<Time> events;
+    std::vector<Time> settled(2 * flaps + 1);
+    Time t = Seconds(5);
+    for (uint32_t k = 0; k <= 2 * flaps; ++k, t += gap)
+    {
+      events.push_back(t);
+      Simulator::Schedule(t, [&, k] {
+        if (k % 2 == 0)
+          speakers[0]->Originate(table);
+        else
+          for (const auto &r : table)
+            speakers[0]->Withdraw(r.prefix, r.mask);
+      });
+      Simulator::Schedule(t + gap - MilliSeconds(1), [&, k] {
+        for (const auto &s : speakers)
+          settled[k] = std::max(settled[k], s->GetStats().lastBestPathChange);
+      });
+    }
+
+    Simulator::Stop(t);
+    auto start = std::chrono::steady_clock::now();
+    Simulator::Run();
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t updates = 0;
+    uint64_t sent = 0;
+    for (const auto &s : speakers)
+    {
+      updates += s->GetStats().messagesSent[BGP_UPDATE];
+      sent += s->GetStats().prefixesSent;
+    }
+    double convergence = 0;
+    for (uint32_t k = 0; k < events.size(); ++k)
+      convergence += std::max(Seconds(0), settled[k] - events[k]).GetSeconds() / events.size();
+
+    std::cout << (batching ? "Batching, MRAI " + std::to_string(mrai.GetSeconds()) + " s: " : "One UPDATE per prefix: ")
+              << updates << " UPDATEs, " << sent << " prefixes sent, mean convergence " << convergence
+              << " s, " << wall << " s wall" << std::endl;
+    Simulator::Destroy();
+    Ipv4AddressGenerator::Reset(); // the next run reuses the same addresses
+  }
+}
+
+// Churn storm: the first AS of an nAs clique withdraws and re-announces
+// `prefixes` prefixes every `interval`, `flaps` times over, like a
+// customer behind an unstable link. Runs without and with flap damping on
+// every speaker and reports the UPDATEs the speakers processed, the CPU
+// time per UPDATE and the simulator events executed.
+static void BenchmarkFlapStorm(uint32_t nAs, uint32_t prefixes, uint32_t flaps, Time interval)
+{
+  std::vector<BgpRoute> table;
+  for (const auto &r : GenerateFullTable(prefixes, 4))
+    table.emplace_back(r.prefix, r.mask, std::vector<uint32_t>());
+
+  std::cout << "\n=== CHURN STORM (" << nAs << "-AS clique, " << prefixes << " prefixes flapping every "
+            << interval.GetSeconds() << " s, " << flaps << " times) ===" << std::endl;
+  for (bool damping : {false, true})
+  {
+    std::vector<Ptr<BgpSpeaker>> speakers = BuildClique(nAs);
+    for (const auto &s : speakers)
+      s->SetAttribute("Damping", BooleanValue(damping));
+
+    Time t = Seconds(5);
+    Simulator::Schedule(t, [&] { speakers[0]->Originate(table); });
+    for (uint32_t k = 0; k < flaps; ++k)
+    {
+      Simulator::Schedule(t += interval, [&] {
+        for (const auto &r : table)
+          speakers[0]->Withdraw(r.prefix, r.mask);
+      });
+      Simulator::Schedule(t += interval, [&] { speakers[0]->Originate(table); });
+    }
+
+    Simulator::Stop(t + interval);
+    uint64_t eventsBefore = Simulator::GetEventCount();
+    std::clock_t cpuStart = std::clock();
+    Simulator::Run();
+    double cpu = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    uint64_t events = Simulator::GetEventCount() - eventsBefore;
+
+    uint64_t updates = 0;
+    uint64_t updateNs = 0;
+    uint64_t suppressions = 0;
+    uint64_t reuses = 0;
+    std::size_t suppressed = 0;
+    for (const auto &s : speakers)
+    {
+      updates += s->GetStats().updatesReceived;
+      updateNs += s->GetStats().updateWallNs;
+      suppressions += s->GetStats().suppressions;
+      reuses += s->GetStats().reuses;
+      suppressed += s->GetNSuppressed();
+    }
+
+    std::cout << (damping ? "Damping:    " : "No damping: ") << updates << " UPDATEs processed, "
+              << updateNs / 1e3 / std::max<uint64_t>(updates, 1) << " us each (" << cpu * 1e6 / std::max<uint64_t>(updates, 1)
+              << " us of total CPU), " << events << " events, " << cpu << " s CPU | " << suppressions
+              << " suppressions, " << reuses << " reuses, " << suppressed << " routes suppressed at the end"
+              << std::endl;
+    Simulator::Destroy();
+    Ipv4AddressGenerator::Reset();
+  }
+}
+
+/* ================= LEAK TRAFFIC ================= */
+
+// Counts the packets of one flow that a node forwards (Ipv4L3Protocol's
+// UnicastForward trace), i.e. traffic pulled through a leaking AS
+struct FlowForwardCounter
+{
+  Ipv4Address destination;
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+  Time first = Time::Max();
+
+  void Forwarded(const Ipv4Header &header, Ptr<const Packet> packet, uint32_t)
+  {
+    if (header.GetDestination() != destination)
+      return;
+    packets++;
+    bytes += packet->GetSize();
+    first = std::min(first, Simulator::Now());
+  }
+};
+
+/* ================= GENERATED TOPOLOGIES ================= */
+
+// AS-level graph; links refer to ASes by index, rel is what b is to a
+struct AsGraph
+{
+  struct Link
+  {
+    uint32_t a;
+    uint32_t b;
+    BgpRelationship rel;
+  };
+
+  std::vector<uint32_t> ases;
+  std::vector<Link> links;
+
+  void FillRelationships(AsRelationships &db) const
+  {
+    for (const auto &l : links)
+    {
+      if (l.rel == BGP_PEER)
+        db.AddPeers(ases[l.a], ases[l.b]);
+      else
+        db.AddProviderCustomer(ases[l.a], ases[l.b]);
+    }
+  }
 };
 
+// CAIDA as-rel file ("provider|customer|-1" or "peer|peer|0" per line,
+// '#' starts a comment), cut down to the n ASes with the most links and
+// the links among them
+static AsGraph LoadAsRelFile(const std::string &path, uint32_t n)
+{
+  std::ifstream in(path);
+  if (!in)
+    NS_FATAL_ERROR("Cannot open AS relationship file " << path);
+
+  struct Edge
+  {
+    uint32_t a;
+    uint32_t b;
+    int rel;
+  };
+  std::vector<Edge> edges;
+  std::unordered_map<uint32_t, uint32_t> degree;
+  std::string line;
+  while (std::getline(in, line))
+  {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::replace(line.begin(), line.end(), '|', ' ');
+    std::istringstream fields(line);
+    Edge e;
+    if (!(fields >> e.a >> e.b >> e.rel) || (e.rel != -1 && e.rel != 0) || e.a == e.b)
+      continue;
+    edges.push_back(e);
+    degree[e.a]++;
+    degree[e.b]++;
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> byDegree; // (degree, asn)
+  for (const auto &d : degree)
+    byDegree.emplace_back(d.second, d.first);
+  std::sort(byDegree.begin(), byDegree.end(), [](const auto &x, const auto &y) {
+    return x.first != y.first ? x.first > y.first : x.second < y.second;
+  });
+  byDegree.resize(std::min<std::size_t>(n, byDegree.size()));
+
+  AsGraph g;
+  std::unordered_map<uint32_t, uint32_t> index;
+  for (const auto &d : byDegree)
+  {
+    index[d.second] = g.ases.size();
+    g.ases.push_back(d.second);
+  }
+  for (const auto &e : edges)
+  {
+    auto a = index.find(e.a);
+    auto b = index.find(e.b);
+    if (a != index.end() && b != index.end())
+      g.links.push_back({a->second, b->second, e.rel == 0 ? BGP_PEER : BGP_CUSTOMER});
+  }
+  return g;
+}
+
+// Synthetic Internet-like AS graph by preferential attachment: a clique of
+// four tier-1s peering with each other, then every new AS buys transit
+// from one or (a third of the time) two existing ASes picked with
+// probability proportional to their degree, and one in five also peers
+// with a random older AS. Providers are always older than their customers,
+// so there are no provider loops and every AS reaches the tier-1s.
+static AsGraph GenerateAsGraph(uint32_t n, uint32_t seed)
+{
+  const uint32_t kFirstAsn = 4200000000u; // private 4-octet range
+  const uint32_t kTier1 = std::min<uint32_t>(n, 4);
+
+  AsGraph g;
+  std::mt19937 rng(seed);
+  std::vector<uint32_t> ends; // both ends of every link: a draw is degree-proportional
+  auto link = [&](uint32_t a, uint32_t b, BgpRelationship rel) {
+    g.links.push_back({a, b, rel});
+    ends.push_back(a);
+    ends.push_back(b);
+  };
+
+  for (uint32_t i = 0; i < n; ++i)
+    g.ases.push_back(kFirstAsn + i);
+  for (uint32_t i = 0; i < kTier1; ++i)
+    for (uint32_t j = i + 1; j < kTier1; ++j)
+      link(i, j, BGP_PEER);
+
+  for (uint32_t i = kTier1; i < n; ++i)
+  {
+    uint32_t want = rng() % 3 == 0 ? 2 : 1;
+    std::vector<uint32_t> providers;
+    while (providers.size() < want)
+    {
+      uint32_t p = ends[rng() % ends.size()];
+      if (std::find(providers.begin(), providers.end(), p) == providers.end())
+        providers.push_back(p);
+    }
+    for (uint32_t p : providers)
+      link(p, i, BGP_CUSTOMER);
+
+    uint32_t peer = rng() % i;
+    if (rng() % 5 == 0 && std::find(providers.begin(), providers.end(), peer) == providers.end())
+      link(peer, i, BGP_PEER);
+  }
+  return g;
+}
+
+// Builds the graph as a network and runs BGP on it until simTime. Every AS
+// is a border router running a BgpSpeaker with all of the AS's eBGP
+// sessions, and a core router behind it on an internal link; the AS
+// originates that link's /24 (10.x.y.0, x.y being the AS index). Peer
+// links are IXP links, provider-customer links transit links. Prints one
+// report line: setup and run wall-clock time, wall-clock per simulated
+// second, simulator events and how far the prefixes got.
+static void RunGeneratedTopology(const AsGraph &g, Time simTime, Time mrai)
+{
+  const uint32_t n = g.ases.size();
+  NS_ABORT_MSG_IF(n > 65536, "Generated topologies are limited to 65536 ASes");
+  NS_ABORT_MSG_IF(g.links.size() > (1u << 18), "Generated topologies are limited to 262144 AS links");
+  const Time originateAt = Seconds(2);
+
+  auto setupStart = std::chrono::steady_clock::now();
+  double heapBefore = MemoryInUseMiB();
+
+  NodeContainer cores;
+  NodeContainer borders;
+  cores.Create(n);
+  borders.Create(n);
+  InternetStackHelper internet;
+  internet.Install(cores);
+  internet.Install(borders);
+
+  PointToPointHelper p2p, ixp;
+  p2p.SetDeviceAttribute("DataRate", StringValue("10Mbps"));
+  p2p.SetChannelAttribute("Delay", StringValue("2ms"));
+  ixp.SetDeviceAttribute("DataRate", StringValue("1Gbps"));
+  ixp.SetChannelAttribute("Delay", StringValue("1ms"));
+
+  // Internal links; the core router defaults to its border router
+  Ipv4AddressHelper addr;
+  Ipv4StaticRoutingHelper staticHelper;
+  std::vector<BgpRoute> origins;
+  for (uint32_t i = 0; i < n; ++i)
+  {
+    Ipv4Address base((10u << 24) | (i << 8));
+    addr.SetBase(base, "255.255.255.0");
+    Ipv4InterfaceContainer ifs = addr.Assign(p2p.Install(cores.Get(i), borders.Get(i)));
+    staticHelper.GetStaticRouting(cores.Get(i)->GetObject<Ipv4>())->SetDefaultRoute(ifs.GetAddress(1), 1);
+    origins.emplace_back(base, Ipv4Mask("255.255.255.0"), std::vector<uint32_t>{g.ases[i]});
+  }
+
+  AsRelationships relationships;
+  g.FillRelationships(relationships);
+
+  std::vector<Ptr<BgpSpeaker>> speakers;
+  for (uint32_t i = 0; i < n; ++i)
+  {
+    Ptr<BgpSpeaker> s = CreateObjectWithAttributes<BgpSpeaker>("Asn", UintegerValue(g.ases[i]));
+    s->SetStartTime(Seconds(1));
+    s->SetStopTime(simTime);
+    s->SetAsRelationships(&relationships);
+    s->SetAttribute("Mrai", TimeValue(mrai));
+    borders.Get(i)->AddApplication(s);
+    speakers.push_back(s);
+  }
+
+  // Inter-AS links, one /30 each
+  Ipv4AddressHelper linkAddr("172.16.0.0", "255.255.255.252");
+  for (const auto &l : g.links)
+  {
+    PointToPointHelper &helper = l.rel == BGP_PEER ? ixp : p2p;
+    Ipv4InterfaceContainer ifs = linkAddr.Assign(helper.Install(borders.Get(l.a), borders.Get(l.b)));
+    linkAddr.NewNetwork();
+    BgpRelationship back = l.rel == BGP_CUSTOMER ? BGP_PROVIDER : l.rel;
+    speakers[l.a]->AddNeighbor(g.ases[l.b], ifs.GetAddress(1), l.rel);
+    speakers[l.b]->AddNeighbor(g.ases[l.a], ifs.GetAddress(0), back);
+  }
+
+  for (uint32_t i = 0; i < n; ++i)
+    Simulator::Schedule(originateAt, [&speakers, &origins, i] { speakers[i]->Originate(origins[i]); });
+
+  double setupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - setupStart).count();
+  double heapDelta = MemoryInUseMiB() - heapBefore;
+
+  Simulator::Stop(simTime);
+  uint64_t eventsBefore = Simulator::GetEventCount();
+  auto runStart = std::chrono::steady_clock::now();
+  Simulator::Run();
+  double runSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+  uint64_t events = Simulator::GetEventCount() - eventsBefore;
+
+  Time converged;
+  uint64_t updates = 0;
+  std::size_t routes = 0;
+  uint32_t complete = 0;
+  for (const auto &s : speakers)
+  {
+    converged = std::max(converged, s->GetStats().lastBestPathChange);
+    updates += s->GetStats().messagesSent[BGP_UPDATE];
+    routes += s->GetLocRibSize();
+    complete += s->GetLocRibSize() == n;
+  }
+
+  std::cout << std::setw(6) << n << " ASes " << std::setw(7) << g.links.size() << " links | setup "
+            << setupSeconds << " s, +" << heapDelta << " MiB | run " << runSeconds << " s = "
+            << runSeconds / simTime.GetSeconds() << " s per simulated s, " << events << " events | "
+            << updates << " UPDATEs, converged " << (converged - originateAt).GetSeconds() << " s after origination, "
+            << double(routes) / n << " of " << n << " prefixes per AS (" << complete << " ASes reach all)"
+            << std::endl;
+  Simulator::Destroy();
+  Ipv4AddressGenerator::Reset();
+}
+
 /* ================= MAIN ================= */
 
 int main(int argc, char *argv[])
 {
   Time simTime = Seconds(25);
+  uint32_t prefixes = 0;
+  std::string prefixFile;
+  uint32_t benchRib = 0;
+  bool benchFib = false;
+  uint32_t fibStaticMax = 100000;
+  bool rejectLeaks = false;
+  Time mrai = Seconds(0);
+  bool benchChurn = false;
+  uint32_t churnAs = 6;
+  uint32_t churnPrefixes = 1000;
+  uint32_t churnFlaps = 3;
+  Time churnMrai = Seconds(5);
+  bool benchStorm = false;
+  uint32_t stormAs = 4;
+  uint32_t stormPrefixes = 5000;
+  uint32_t stormFlaps = 10;
+  Time stormInterval = Seconds(10);
+  std::string roaFile;
+  bool rejectInvalid = false;
+  uint32_t genAs = 0;
+  uint32_t genSteps = 4;
+  std::string asRelFile;
   CommandLine cmd;
+  cmd.AddValue("simTime", "Simulation time", simTime);
+  cmd.AddValue("prefixes", "Synthetic full-table prefixes AS65001 injects at t=4s (e.g. 900000; 0 = off)", prefixes);
+  cmd.AddValue("prefixFile", "Inject this text table dump instead of a synthetic one", prefixFile);
+  cmd.AddValue("benchRib", "Compare RIB memory layouts for this many prefixes and exit", benchRib);
+  cmd.AddValue("benchFib", "Compare BGP FIB and static routing lookups at 1k/100k/1M routes and exit", benchFib);
+  cmd.AddValue("fibStaticMax", "Largest table --benchFib loads into static routing (loading is quadratic)", fibStaticMax);
+  cmd.AddValue("rejectLeaks", "Drop routes whose AS_PATH is not valley-free instead of only counting them", rejectLeaks);
+  cmd.AddValue("roaFile", "ROAs to validate received routes against (relying-party CSV export)", roaFile);
+  cmd.AddValue("rejectInvalid", "Drop RPKI-invalid routes instead of only counting them", rejectInvalid);
+  cmd.AddValue("mrai", "MRAI of every speaker (0 = send as soon as the current event is processed)", mrai);
+  cmd.AddValue("benchChurn", "Compare UPDATE counts and convergence with and without batching and exit", benchChurn);
+  cmd.AddValue("churnAs", "ASes in the --benchChurn clique", churnAs);
+  cmd.AddValue("churnPrefixes", "Prefixes flapped in --benchChurn", churnPrefixes);
+  cmd.AddValue("churnFlaps", "Withdraw/announce cycles in --benchChurn", churnFlaps);
+  cmd.AddValue("churnMrai", "MRAI for the batching run of --benchChurn", churnMrai);
+  cmd.AddValue("benchStorm", "Compare a prefix flap storm with and without route flap damping and exit", benchStorm);
+  cmd.AddValue("stormAs", "ASes in the --benchStorm clique", stormAs);
+  cmd.AddValue("stormPrefixes", "Prefixes flapping in --benchStorm", stormPrefixes);
+  cmd.AddValue("stormFlaps", "Withdraw/announce cycles in --benchStorm", stormFlaps);
+  cmd.AddValue("stormInterval", "Time between withdrawal and re-announcement in --benchStorm", stormInterval);
+  cmd.AddValue("genAs", "Run BGP on a generated topology of this many ASes instead of the scenario and exit", genAs);
+  cmd.AddValue("genSteps", "Also run --genAs/2, --genAs/4 ... for this many sizes in all", genSteps);
+  cmd.AddValue("asRelFile", "Take --genAs ASes from this CAIDA as-rel file instead of preferential attachment", asRelFile);
   cmd.Parse(argc, argv);
 
+  if (benchRib > 0)
+  {
+    BenchmarkRibMemory(benchRib);
+    return 0;
+  }
+  if (benchFib)
+  {
+    BenchmarkFib(fibStaticMax);
+    return 0;
+  }
+  if (benchChurn)
+  {
+    BenchmarkChurn(churnAs, churnPrefixes, churnFlaps, churnMrai);
+    return 0;
+  }
+  if (benchStorm)
+  {
+    BenchmarkFlapStorm(stormAs, stormPrefixes, stormFlaps, stormInterval);
+    return 0;
+  }
+  if (genAs > 0)
+  {
+    std::cout << "\n=== GENERATED TOPOLOGIES (" << (asRelFile.empty() ? "preferential attachment" : asRelFile)
+              << ", " << simTime.GetSeconds() << " s simulated) ===" << std::endl;
+    for (uint32_t step = std::max<uint32_t>(genSteps, 1); step-- > 0;)
+    {
+      uint32_t n = std::max<uint32_t>(genAs >> step, 2);
+      RunGeneratedTopology(asRelFile.empty() ? GenerateAsGraph(n, 1) : LoadAsRelFile(asRelFile, n), simTime, mrai);
+    }
+    return 0;
+  }
+
+  // Full segments on the IXP links
+  Config::SetDefault("ns3::TcpSocket::SegmentSize", UintegerValue(1448));
+
+  std::vector<BgpRoute> fullTable;
+  if (!prefixFile.empty())
+    fullTable = LoadPrefixFile(prefixFile);
+  else if (prefixes > 0)
+    fullTable = GenerateFullTable(prefixes, 1);
+
+  // Our own prefixes, plus a full ROA set from a file or, for a
+  // synthetic table, synthetic ROAs covering it
+  RoaTable roas;
+  roas.Add(Ipv4Address("10.1.0.0"), 16, 16, 65001);
+  roas.Add(Ipv4Address("10.2.0.0"), 16, 16, 65002);
+  roas.Add(Ipv4Address("10.3.0.0"), 16, 16, 65003);
+  if (!roaFile.empty())
+    roas.LoadFile(roaFile);
+  else if (!fullTable.empty())
+    AddSyntheticRoas(roas, fullTable, 1);
+
+  LogComponentEnable("InterAS_BGP", LOG_LEVEL_INFO);
+
   NodeContainer nodes;
-  nodes.Create(6);
+  nodes.Create(7); // node 6: AS65003, a customer of both AS65001 and AS65002
 
   InternetStackHelper internet;
   internet.Install(nodes);
@@ -106,6 +3181,10 @@ int main(int argc, char *argv[])
   auto ixpA = ixp.Install(nodes.Get(1), nodes.Get(4));
   auto ixpB = ixp.Install(nodes.Get(2), nodes.Get(5));
 
+  // AS65003's transit links to its two providers
+  auto d16 = p2p.Install(nodes.Get(1), nodes.Get(6));
+  auto d46 = p2p.Install(nodes.Get(4), nodes.Get(6));
+
   /* === ADDRESSING === */
 
   Ipv4AddressHelper addr;
@@ -123,10 +3202,31 @@ int main(int argc, char *argv[])
   addr.Assign(d35);
 
   addr.SetBase("192.168.1.0", "255.255.255.0");
-  addr.Assign(ixpA);
+  Ipv4InterfaceContainer ixpAIf = addr.Assign(ixpA);
 
   addr.SetBase("192.168.2.0", "255.255.255.0");
-  addr.Assign(ixpB);
+  Ipv4InterfaceContainer ixpBIf = addr.Assign(ixpB);
+
+  addr.SetBase("192.168.3.0", "255.255.255.0");
+  Ipv4InterfaceContainer transit1If = addr.Assign(d16);
+
+  addr.SetBase("192.168.4.0", "255.255.255.0");
+  Ipv4InterfaceContainer transit2If = addr.Assign(d46);
+
+  /* === INTRA-AS ROUTING === */
+
+  // Stand-in for an IGP: each core router defaults to its IXP-A border
+  // router, and border routers reach their own /16 through the core
+  Ipv4StaticRoutingHelper staticHelper;
+  auto staticOf = [&](uint32_t n) { return staticHelper.GetStaticRouting(nodes.Get(n)->GetObject<Ipv4>()); };
+
+  staticOf(0)->SetDefaultRoute("10.1.1.2", 1);
+  staticOf(1)->AddNetworkRouteTo("10.1.0.0", "255.255.0.0", "10.1.1.1", 1);
+  staticOf(2)->AddNetworkRouteTo("10.1.0.0", "255.255.0.0", "10.1.2.1", 1);
+
+  staticOf(3)->SetDefaultRoute("10.2.1.2", 1);
+  staticOf(4)->AddNetworkRouteTo("10.2.0.0", "255.255.0.0", "10.2.1.1", 1);
+  staticOf(5)->AddNetworkRouteTo("10.2.0.0", "255.255.0.0", "10.2.2.1", 1);
 
   /* === MOBILITY (NetAnim) === */
 
@@ -140,35 +3240,90 @@ int main(int argc, char *argv[])
   nodes.Get(3)->GetObject<MobilityModel>()->SetPosition({80,50,0});
   nodes.Get(4)->GetObject<MobilityModel>()->SetPosition({90,70,0});
   nodes.Get(5)->GetObject<MobilityModel>()->SetPosition({90,30,0});
+  nodes.Get(6)->GetObject<MobilityModel>()->SetPosition({50,90,0});
 
   /* === BGP === */
 
-  Ptr<BgpSpeaker> as65001 = CreateObject<BgpSpeaker>(65001);
-  Ptr<BgpSpeaker> as65002 = CreateObject<BgpSpeaker>(65002);
+  // One speaker per border router. AS65001 and AS65002 peer over both
+  // IXPs; AS65003 buys transit from both.
+  Ptr<BgpSpeaker> as65001a = CreateObjectWithAttributes<BgpSpeaker>("Asn", UintegerValue(65001)); // node 1, IXP A
+  Ptr<BgpSpeaker> as65001b = CreateObjectWithAttributes<BgpSpeaker>("Asn", UintegerValue(65001)); // node 2, IXP B
+  Ptr<BgpSpeaker> as65002a = CreateObjectWithAttributes<BgpSpeaker>("Asn", UintegerValue(65002)); // node 4, IXP A
+  Ptr<BgpSpeaker> as65002b = CreateObjectWithAttributes<BgpSpeaker>("Asn", UintegerValue(65002)); // node 5, IXP B
+  Ptr<BgpSpeaker> as65003 = CreateObjectWithAttributes<BgpSpeaker>("Asn", UintegerValue(65003));  // node 6
+  std::vector<Ptr<BgpSpeaker>> speakers = {as65001a, as65001b, as65002a, as65002b, as65003};
 
-  as65001->Initialize(nodes.Get(0), Ipv4Address("10.1.1.2"));
-  as65002->Initialize(nodes.Get(3), Ipv4Address("10.2.1.2"));
+  nodes.Get(1)->AddApplication(as65001a);
+  nodes.Get(2)->AddApplication(as65001b);
+  nodes.Get(4)->AddApplication(as65002a);
+  nodes.Get(5)->AddApplication(as65002b);
+  nodes.Get(6)->AddApplication(as65003);
+
+  as65001a->AddNeighbor(65002, ixpAIf.GetAddress(1), BGP_PEER);
+  as65002a->AddNeighbor(65001, ixpAIf.GetAddress(0), BGP_PEER);
+  as65001b->AddNeighbor(65002, ixpBIf.GetAddress(1), BGP_PEER);
+  as65002b->AddNeighbor(65001, ixpBIf.GetAddress(0), BGP_PEER);
+  as65001a->AddNeighbor(65003, transit1If.GetAddress(1), BGP_CUSTOMER);
+  as65002a->AddNeighbor(65003, transit2If.GetAddress(1), BGP_CUSTOMER);
+  as65003->AddNeighbor(65001, transit1If.GetAddress(0), BGP_PROVIDER);
+  as65003->AddNeighbor(65002, transit2If.GetAddress(0), BGP_PROVIDER);
+
+  AsRelationships relationships;
+  relationships.AddPeers(65001, 65002);
+  relationships.AddProviderCustomer(65001, 65003);
+  relationships.AddProviderCustomer(65002, 65003);
+
+  for (auto &s : speakers)
+  {
+    s->SetStartTime(Seconds(1));
+    s->SetStopTime(simTime);
+    s->SetAsRelationships(&relationships);
+    s->SetAttribute("RejectLeaks", BooleanValue(rejectLeaks));
+    s->SetRoaTable(&roas);
+    s->SetAttribute("RejectInvalid", BooleanValue(rejectInvalid));
+    s->SetAttribute("Mrai", TimeValue(mrai));
+  }
+
+  /* === FULL-TABLE INJECTION === */
+
+  Time injectAt = Seconds(4);
+  double heapBefore = 0;
+  if (!fullTable.empty())
+  {
+    Simulator::Schedule(injectAt, [&] {
+      heapBefore = MemoryInUseMiB();
+      as65001a->Originate(fullTable);
+    });
+  }
 
-  as65001->AddNeighbor(65002);
-  as65002->AddNeighbor(65001);
+  Time lastOrigination = Seconds(3);
 
   Simulator::Schedule(Seconds(2), [&] {
     BgpRoute r{Ipv4Address("10.1.0.0"), Ipv4Mask("255.255.0.0"), {65001}};
-    as65001->Advertise(r);
-    as65002->InstallRoute(r.prefix, r.mask);
+    as65001a->Originate(r);
+    as65001b->Originate(r);
   });
 
-  Simulator::Schedule(Seconds(3), [&] {
+  Simulator::Schedule(lastOrigination, [&] {
     BgpRoute r{Ipv4Address("10.2.0.0"), Ipv4Mask("255.255.0.0"), {65002}};
-    as65002->Advertise(r);
-    as65001->InstallRoute(r.prefix, r.mask);
+    as65002a->Originate(r);
+    as65002b->Originate(r);
+    as65003->Originate(BgpRoute{Ipv4Address("10.3.0.0"), Ipv4Mask("255.255.0.0"), {65003}});
   });
 
   /* === ROUTE LEAK === */
 
+  Time converged;
   Simulator::Schedule(Seconds(10), [&] {
-    NS_LOG_UNCOND("\n[SECURITY] ROUTE LEAK OCCURRED");
-    as65002->InstallRoute(Ipv4Address("10.1.0.0"), Ipv4Mask("255.255.0.0"));
+    // Convergence is measured on the legitimate announcements only
+    for (const auto &s : speakers)
+      converged = std::max(converged, s->GetStats().lastRouteChange);
+
+    // AS65003 drops its export filter and re-announces each provider's
+    // routes to the other; as a customer route the leak beats the peering
+    NS_LOG_UNCOND("\n[SECURITY] ROUTE LEAK: AS65003 re-exports its providers' routes");
+    as65003->SetAttribute("ValleyFree", BooleanValue(false));
+    as65003->RefreshExports();
   });
 
   /* === ROUTING TABLE DUMP === */
@@ -177,6 +3332,8 @@ int main(int argc, char *argv[])
     NS_LOG_UNCOND("\n=== ROUTING TABLES ===");
     Ipv4GlobalRoutingHelper::PrintRoutingTableAllAt(
       Seconds(12), Create<OutputStreamWrapper>(&std::cout));
+    for (const auto &s : speakers)
+      s->PrintLocRib(std::cout);
   });
 
   /* === UDP TRAFFIC === */
@@ -184,7 +3341,8 @@ int main(int argc, char *argv[])
   uint16_t port = 9000;
 
   UdpServerHelper server(port);
-  server.Install(nodes.Get(3))->Start(Seconds(1));
+  ApplicationContainer serverApp = server.Install(nodes.Get(3));
+  serverApp.Start(Seconds(1));
 
   UdpClientHelper client(Ipv4Address("10.2.1.1"), port);
   client.SetAttribute("Interval", TimeValue(MilliSeconds(100)));
@@ -193,6 +3351,11 @@ int main(int argc, char *argv[])
 
   client.Install(nodes.Get(0))->Start(Seconds(5));
 
+  FlowForwardCounter leakedFlow;
+  leakedFlow.destination = Ipv4Address("10.2.1.1");
+  nodes.Get(6)->GetObject<Ipv4L3Protocol>()->TraceConnectWithoutContext(
+    "UnicastForward", MakeCallback(&FlowForwardCounter::Forwarded, &leakedFlow));
+
   /* === OUTPUT === */
 
   AnimationInterface anim("scratch/ex6-interas.xml");
@@ -202,7 +3365,108 @@ int main(int argc, char *argv[])
   ixp.EnablePcapAll("scratch/ex6-ixp");
 
   Simulator::Stop(simTime);
+  auto wallStart = std::chrono::steady_clock::now();
   Simulator::Run();
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  /* === BGP REPORT === */
+
+  std::cout << "\n=== BGP SESSION REPORT ===" << std::endl;
+  uint64_t totalMessages = 0;
+  uint64_t totalBytes = 0;
+  for (const auto &s : speakers)
+  {
+    const BgpStats &st = s->GetStats();
+    uint64_t messages = 0;
+    for (uint64_t m : st.messagesSent)
+      messages += m;
+    totalMessages += messages;
+    totalBytes += st.bytesSent;
+
+    std::cout << "AS" << s->GetAsn() << " node " << s->GetNode()->GetId()
+              << ": sent OPEN " << st.messagesSent[BGP_OPEN]
+              << " UPDATE " << st.messagesSent[BGP_UPDATE] << " (" << st.prefixesSent << " prefixes)"
+              << " KEEPALIVE " << st.messagesSent[BGP_KEEPALIVE]
+              << " NOTIFICATION " << st.messagesSent[BGP_NOTIFICATION]
+              << " (" << st.bytesSent << " B) | received " << st.messagesReceived
+              << " (" << st.bytesReceived << " B), " << st.prefixesReceived
+              << " prefixes | " << s->GetNEstablished() << " established" << std::endl;
+    std::cout << "    Adj-RIB-In " << s->GetAdjRibInSize() << ", Loc-RIB " << s->GetLocRibSize()
+              << ", Adj-RIB-Out " << s->GetAdjRibOutSize() << " | " << st.decisions
+              << " decisions, " << st.bestPathChanges << " best-path changes | RPKI valid "
+              << st.rpki[RPKI_VALID] << ", invalid " << st.rpki[RPKI_INVALID] << ", not found "
+              << st.rpki[RPKI_NOT_FOUND] << std::endl;
+  }
+  std::cout << "Total: " << totalMessages << " messages, " << totalBytes << " bytes on the wire" << std::endl;
+  std::cout << "Last route change at " << converged.GetSeconds() << "s, "
+            << (converged - lastOrigination).GetMilliSeconds()
+            << " ms after the last origination" << std::endl;
+  std::cout << "UDP 10.1 -> 10.2 packets received: "
+            << DynamicCast<UdpServer>(serverApp.Get(0))->GetReceived() << std::endl;
+
+  std::cout << "\n=== ROUTE LEAK REPORT ===" << std::endl;
+  for (const auto &s : speakers)
+  {
+    const BgpStats &st = s->GetStats();
+    if (st.leakUpdates == 0)
+      continue;
+    std::cout << "AS" << s->GetAsn() << " node " << s->GetNode()->GetId() << ": " << st.leakUpdates
+              << " leaked UPDATEs (" << st.leakedPrefixes << " prefixes), first at "
+              << st.firstLeak.GetSeconds() << "s" << (rejectLeaks ? ", rejected" : "") << std::endl;
+  }
+  std::cout << "UDP flow through AS65003: " << leakedFlow.packets << " packets, " << leakedFlow.bytes << " B";
+  if (leakedFlow.packets > 0)
+    std::cout << ", from t=" << leakedFlow.first.GetSeconds() << "s";
+  std::cout << std::endl;
+
+  if (!fullTable.empty())
+  {
+    const BgpStats &tx = as65001a->GetStats();
+    const BgpStats &rx = as65002a->GetStats();
+    std::size_t entries = 0;
+    for (const auto &s : speakers)
+      entries += s->GetAdjRibInSize() + s->GetLocRibSize() + s->GetAdjRibOutSize();
+    entries += fullTable.size(); // AS65001's table of originated routes
+    std::size_t tableBytes = 0;
+    std::size_t fibRoutes = 0;
+    std::size_t fibBytes = 0;
+    for (const auto &s : speakers)
+    {
+      tableBytes += s->GetRibMemoryBytes();
+      fibRoutes += s->GetFib()->GetNRoutes();
+      fibBytes += s->GetFib()->GetMemoryBytes();
+    }
+    double heapDelta = MemoryInUseMiB() - heapBefore;
+    double updateSecs = rx.updateWallNs / 1e9;
+
+    std::cout << "\n=== FULL-TABLE SCALE TEST (" << fullTable.size() << " prefixes) ===" << std::endl;
+    std::cout << "AS65002 node 4 Loc-RIB: " << as65002a->GetLocRibSize() << " prefixes, "
+              << rx.prefixesReceived << " received in " << rx.updatesReceived << " UPDATEs ("
+              << rx.bytesReceived / 1e6 << " MB)" << std::endl;
+    std::cout << "Convergence: " << (rx.lastBestPathChange - injectAt).GetSeconds()
+              << " s simulated after injection at t=" << injectAt.GetSeconds() << "s" << std::endl;
+    if (updateSecs > 0)
+      std::cout << "UPDATE processing at AS65002: " << rx.updatesReceived / updateSecs << " UPDATEs/s, "
+                << rx.prefixesReceived / updateSecs << " prefixes/s (" << updateSecs << " s wall)" << std::endl;
+    else
+      std::cout << "UPDATE processing at AS65002: no UPDATE processed" << std::endl;
+    uint64_t validated = rx.rpki[RPKI_VALID] + rx.rpki[RPKI_INVALID] + rx.rpki[RPKI_NOT_FOUND];
+    std::cout << "RPKI origin validation at AS65002 against " << roas.size() << " ROAs: "
+              << double(rx.rpkiWallNs) / std::max<uint64_t>(validated, 1) << " ns per route, "
+              << 100.0 * rx.rpkiWallNs / std::max<uint64_t>(rx.updateWallNs, 1) << "% of UPDATE processing"
+              << std::endl;
+    std::cout << "AS65001 sent " << tx.messagesSent[BGP_UPDATE] << " UPDATEs carrying " << tx.prefixesSent
+              << " prefixes, " << tx.bytesSent / 1e6 << " MB" << std::endl;
+    std::cout << "Memory: heap +" << heapDelta << " MiB for " << entries << " RIB entries and " << fibRoutes
+              << " FIB routes on " << speakers.size() << " speakers = " << heapDelta * (1 << 20) / fullTable.size() << " B per prefix"
+              << std::endl;
+    std::cout << "RIB tables: " << tableBytes / double(1 << 20) << " MiB; shared: " << AsPath::GetNInterned()
+              << " AS paths, " << BgpAttrSet::GetNInterned() << " attribute sets" << std::endl;
+    std::cout << "FIB tries: " << fibBytes / double(1 << 20) << " MiB for " << fibRoutes << " routes" << std::endl;
+    std::cout << "Wall clock: " << wallSeconds << " s for " << simTime.GetSeconds() << " s simulated"
+              << std::endl;
+  }
+
   Simulator::Destroy();
 
   return 0;